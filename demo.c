@@ -1,4 +1,9 @@
 #include "demo.h"
+#include "dynres.h"
+#include "job_pool.h"
+#include "mesh.h"
+#include "settings.h"
+#include "stream.h"
 #include <string.h>
 #include <math.h>
 
@@ -10,23 +15,53 @@ struct demo_state
     float rotation_x;
     float rotation_y;
     int frame_counter;
+    int has_mesh;
+    struct mesh mesh;
+    int has_stream;
+    struct stream stream;
+    struct rasterizer_depth_buffer depth_buffer;
+    struct rasterizer_visibility_buffer visibility_buffer;
+    struct rasterizer_msaa_buffer msaa_buffer;
+    struct job_pool job_pool;
+    int has_dynres;
+    struct dynres dynres;
 };
 
 void demo_reshape(struct demo_state *ds, int screenw, int screenh);
-void demo_set_world_matrix(struct demo_state *ds, int index);
+void demo_get_world_matrix(struct demo_state *ds, int index, mat4x4 *world_matrix);
+void demo_set_mesh_world_matrix(struct demo_state *ds, const float scale[3], const float bias[3]);
 void demo_set_view_matrix(struct demo_state *ds);
-void draw_wire_box(struct demo_state *ds);
+void draw_wire_boxes(struct demo_state *ds, const mat4x4 *world_matrices, size_t count);
 void demo_frame(struct demo_state *ds);
 
 struct demo_state *demo_init(int screenw, int screenh, struct rasterizer_functions *functions)
 {
     struct demo_state *ds = (struct demo_state *)malloc(sizeof(struct demo_state));
-    memcpy(&ds->rs.functions, functions, sizeof(ds->rs.functions));
-    mat4x4_identity(&ds->rs.world_matrix);
-    mat4x4_identity(&ds->rs.view_matrix);
+
+    // with dynamic resolution the context renders into its internal target, which presents to the backend
+    struct rasterizer_functions dynres_functions;
+    ds->has_dynres = (DYNAMIC_RESOLUTION_BUDGET_MS > 0 &&
+                      dynres_init(&ds->dynres, screenw, screenh, functions, (float)DYNAMIC_RESOLUTION_BUDGET_MS,
+                                  DYNAMIC_RESOLUTION_FILTER ? DYNRES_FILTER_BILINEAR : DYNRES_FILTER_NEAREST) == 0);
+    if (ds->has_dynres)
+        dynres_get_functions(&ds->dynres, &dynres_functions);
+
+    rasterizer_init(&ds->rs, ds->has_dynres ? &dynres_functions : functions);
+#if defined(COLOR_INTERPOLATION)
+    rasterizer_set_flags(&ds->rs, RASTERIZER_FLAG_COLOR_INTERPOLATION);
+#else
+    rasterizer_set_flags(&ds->rs, 0);
+#endif
     ds->rotation_x = 45.0f;
     ds->rotation_y = 0.0f;
     ds->frame_counter = 0;
+    ds->has_mesh = 0;
+    ds->has_stream = 0;
+    memset(&ds->depth_buffer, 0, sizeof(ds->depth_buffer));
+    memset(&ds->visibility_buffer, 0, sizeof(ds->visibility_buffer));
+    memset(&ds->msaa_buffer, 0, sizeof(ds->msaa_buffer));
+    if (WORKER_THREADS > 0 && job_pool_init(&ds->job_pool, WORKER_THREADS) == 0)
+        rasterizer_set_job_pool(&ds->rs, &ds->job_pool);
     demo_reshape(ds, screenw, screenh);
     return ds;
 }
@@ -35,14 +70,67 @@ void demo_reshape(struct demo_state *ds, int screenw, int screenh)
 {
     ds->screenw = screenw;
     ds->screenh = screenh;
+    if (ds->has_dynres)
+        dynres_resize(&ds->dynres, screenw, screenh);
 
-    ds->rs.viewport.top_left_x = 0;
-    ds->rs.viewport.top_left_y = 0;
-    ds->rs.viewport.width = screenw;
-    ds->rs.viewport.height = screenh;
-    
-    mat4x4_ortho(&ds->rs.projection_matrix, 6.0f, 6.0f, 0.1f, 10.0f);
-    //mat4x4_perspective(&ds->rs.projection_matrix, 90.0f, (float)screenw / (float)screenh, 0.1f, 10.0f);
+    // the buffers stay at the screen size, dynamic resolution only uses their top-left corner
+    struct viewport_state viewport;
+    viewport.top_left_x = 0;
+    viewport.top_left_y = 0;
+    viewport.width = screenw;
+    viewport.height = screenh;
+    rasterizer_set_viewport(&ds->rs, &viewport);
+
+    rasterizer_depth_buffer_destroy(&ds->depth_buffer);
+    if (rasterizer_depth_buffer_init(&ds->depth_buffer, screenw, screenh) == 0)
+        rasterizer_set_depth_buffer(&ds->rs, &ds->depth_buffer);
+    else
+        rasterizer_set_depth_buffer(&ds->rs, NULL);
+
+    rasterizer_visibility_buffer_destroy(&ds->visibility_buffer);
+    if (VISIBILITY_BUFFER && rasterizer_visibility_buffer_init(&ds->visibility_buffer, screenw, screenh) == 0)
+        rasterizer_set_visibility_buffer(&ds->rs, &ds->visibility_buffer);
+    else
+        rasterizer_set_visibility_buffer(&ds->rs, NULL);
+
+    rasterizer_msaa_buffer_destroy(&ds->msaa_buffer);
+    if (MSAA_SAMPLES != 0 && rasterizer_msaa_buffer_init(&ds->msaa_buffer, screenw, screenh, MSAA_SAMPLES) == 0)
+        rasterizer_set_msaa_buffer(&ds->rs, &ds->msaa_buffer);
+    else
+        rasterizer_set_msaa_buffer(&ds->rs, NULL);
+
+    mat4x4 projection_matrix;
+    mat4x4_ortho(&projection_matrix, 6.0f, 6.0f, 0.1f, 10.0f);
+    //mat4x4_perspective(&projection_matrix, 90.0f, (float)screenw / (float)screenh, 0.1f, 10.0f);
+    rasterizer_set_projection_matrix(&ds->rs, &projection_matrix);
+}
+
+int demo_load_mesh(struct demo_state *ds, const char *filename)
+{
+    if (ds->has_mesh)
+    {
+        mesh_unload(&ds->mesh);
+        ds->has_mesh = 0;
+    }
+
+    if (ds->has_stream)
+    {
+        stream_close(&ds->stream);
+        ds->has_stream = 0;
+    }
+
+    // stream files are read in chunks as they come into view, anything else has to be a mesh
+    if (stream_open(&ds->stream, filename, (size_t)STREAMING_BUDGET_KB * 1024) == 0)
+    {
+        ds->has_stream = 1;
+        return 0;
+    }
+
+    if (mesh_load(&ds->mesh, filename) != 0)
+        return -1;
+
+    ds->has_mesh = 1;
+    return 0;
 }
 
 void demo_rotate_up(struct demo_state *ds)
@@ -65,7 +153,7 @@ void demo_rotate_right(struct demo_state *ds)
     ds->rotation_y = fmodf(ds->rotation_y + 5.0f, 360.0f);
 }
 
-void demo_set_world_matrix(struct demo_state *ds, int index)
+void demo_get_world_matrix(struct demo_state *ds, int index, mat4x4 *world_matrix)
 {
     const int FULL_ROTATION_FRAMES = 150;
 
@@ -75,7 +163,26 @@ void demo_set_world_matrix(struct demo_state *ds, int index)
     mat4x4 translation_matrix;
     mat4x4_rotate_y(&rotation_matrix, rotation);
     mat4x4_translate(&translation_matrix, -2.25f + (float)index + (float)index * 0.5f, 0.0f, 0.0f);
-    mat4x4_mul(&ds->rs.world_matrix, &translation_matrix, &rotation_matrix);
+    mat4x4_mul(world_matrix, &translation_matrix, &rotation_matrix);
+}
+
+void demo_set_mesh_world_matrix(struct demo_state *ds, const float scale[3], const float bias[3])
+{
+    const int FULL_ROTATION_FRAMES = 150;
+
+    float rotation = ((float)(ds->frame_counter % FULL_ROTATION_FRAMES) / (float)FULL_ROTATION_FRAMES) * 360.0f;
+
+    // centre the mesh and fit its largest axis into the same space as the four boxes
+    float extent = fmaxf(scale[0], fmaxf(scale[1], scale[2])) * 32767.0f;
+    float fit = 2.0f / extent;
+
+    mat4x4 rotation_matrix, scale_matrix, centre_matrix, temp, world_matrix;
+    mat4x4_rotate_y(&rotation_matrix, rotation);
+    mat4x4_scale(&scale_matrix, fit, fit, fit);
+    mat4x4_translate(&centre_matrix, -bias[0], -bias[1], -bias[2]);
+    mat4x4_mul(&temp, &scale_matrix, &centre_matrix);
+    mat4x4_mul(&world_matrix, &rotation_matrix, &temp);
+    rasterizer_set_world_matrix(&ds->rs, &world_matrix);
 }
 
 void demo_set_view_matrix(struct demo_state *ds)
@@ -85,14 +192,15 @@ void demo_set_view_matrix(struct demo_state *ds)
     mat4x4_rotate_x(&rotation_x, ds->rotation_x);
     mat4x4_rotate_y(&rotation_y, ds->rotation_y);
 
-    mat4x4 rotation, translation;
+    mat4x4 rotation, translation, view_matrix;
     mat4x4_mul(&rotation, &rotation_y, &rotation_x);
     mat4x4_translate(&translation, 0.0f, -1.0f, -1.0f);
 
-    mat4x4_mul(&ds->rs.view_matrix, &rotation, &translation);
+    mat4x4_mul(&view_matrix, &rotation, &translation);
+    rasterizer_set_view_matrix(&ds->rs, &view_matrix);
 }
 
-void draw_wire_box(struct demo_state *ds)
+void draw_wire_boxes(struct demo_state *ds, const mat4x4 *world_matrices, size_t count)
 {
     static const rasterizer_vertex cube_verts[] =
     {
@@ -122,91 +230,128 @@ void draw_wire_box(struct demo_state *ds)
         { -0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 0) },
     };
 
-    rasterizer_draw_line_list(&ds->rs, cube_verts, sizeof(cube_verts) / sizeof(cube_verts[0]));
+    rasterizer_draw_line_list_instanced(&ds->rs, cube_verts, sizeof(cube_verts) / sizeof(cube_verts[0]), world_matrices, NULL, count);
 }
 
-void draw_box(struct demo_state *ds)
+void draw_boxes(struct demo_state *ds, const mat4x4 *world_matrices, size_t count)
 {
-    // these are stolen from my game engine which is z-up.. seems to work okay though
+    // these are stolen from my game engine which is z-up.. seems to work okay though. the faces don't share vertices,
+    // so the front face's colours stay on it and the rest are white.
     static const rasterizer_vertex cube_verts[] =
     {
         // front face
         { -0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 0) },    // bottom-front-left
         { 0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 0, 0) },    // bottom-front-right
         { -0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 0) },    // top-front-left
-        { -0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 0) },    // top-front-left
-        { 0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 0, 0) },    // bottom-front-right
         { 0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 0, 0) },    // top-front-right
 
         // back face
         { -0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-left
         { -0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-left
         { 0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-right
-        { 0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-right
-        { -0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-left
         { 0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-right
 
         // left face
-        { -0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-left
-        { -0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-left
-        { -0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-left
-        { -0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-left
-        { -0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-left
-        { -0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-front-left
+        { -0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-left
+        { -0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-front-left
+        { -0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-left
+        { -0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-left
 
         // right face
-        { 0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-right
-        { 0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-right
-        { 0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-right
-        { 0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-right
-        { 0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-right
-        { 0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-front-right
+        { 0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-right
+        { 0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-right
+        { 0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-front-right
+        { 0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-right
 
         // top face
         { -0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-front-left
         { 0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-front-right
         { -0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-left
-        { -0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-left
-        { 0.5f, -0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-front-right
         { 0.5f, 0.5f, 0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // top-back-right
 
         // bottom face
         { -0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-left
         { -0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-left
         { 0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-right
-        { 0.5f, -0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-front-right
-        { -0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-left
         { 0.5f, 0.5f, -0.5f, MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) },    // bottom-back-right
     };
 
-    rasterizer_draw_triangle_list(&ds->rs, cube_verts, sizeof(cube_verts) / sizeof(cube_verts[0]));
+    // one four-vertex strip per face
+    static const unsigned int cube_indices[] =
+    {
+        0, 1, 2, 3, RASTERIZER_PRIMITIVE_RESTART_INDEX,        // front face
+        4, 5, 6, 7, RASTERIZER_PRIMITIVE_RESTART_INDEX,        // back face
+        8, 9, 10, 11, RASTERIZER_PRIMITIVE_RESTART_INDEX,      // left face
+        12, 13, 14, 15, RASTERIZER_PRIMITIVE_RESTART_INDEX,    // right face
+        16, 17, 18, 19, RASTERIZER_PRIMITIVE_RESTART_INDEX,    // top face
+        20, 21, 22, 23,                                        // bottom face
+    };
+
+    rasterizer_draw_indexed_triangle_strip_instanced(&ds->rs, cube_verts, sizeof(cube_verts) / sizeof(cube_verts[0]), cube_indices, sizeof(cube_indices) / sizeof(cube_indices[0]), world_matrices, NULL, count);
 }
 
 void demo_frame(struct demo_state *ds)
 {
     ds->frame_counter++;
     demo_set_view_matrix(ds);
+    if (ds->has_dynres)
+    {
+        struct viewport_state viewport;
+        dynres_begin_frame(&ds->dynres, &viewport);
+        rasterizer_set_viewport(&ds->rs, &viewport);
+    }
 
     ds->rs.functions.clear(ds->rs.functions.userdata);
+    if (ds->rs.depth_buffer != NULL)
+        rasterizer_depth_buffer_clear(ds->rs.depth_buffer);
+    if (ds->rs.msaa_buffer != NULL)
+        rasterizer_msaa_buffer_clear(ds->rs.msaa_buffer);
 
-    demo_set_world_matrix(ds, 0);
-    //draw_wire_box(ds);
-    draw_box(ds);
+    if (ds->has_mesh)
+    {
+        struct rasterizer_bounds bounds;
+        mesh_get_bounds(&ds->mesh, &bounds);
+        rasterizer_set_bounds(&ds->rs, &bounds);
+        demo_set_mesh_world_matrix(ds, ds->mesh.scale, ds->mesh.bias);
+        mesh_draw(&ds->rs, &ds->mesh);
+        rasterizer_resolve_visibility(&ds->rs);
+        rasterizer_resolve_msaa(&ds->rs);
+        ds->rs.functions.present(ds->rs.functions.userdata);
+        return;
+    }
+
+    if (ds->has_stream)
+    {
+        struct rasterizer_bounds bounds;
+        stream_get_bounds(&ds->stream, &bounds);
+        rasterizer_set_bounds(&ds->rs, &bounds);
+        demo_set_mesh_world_matrix(ds, ds->stream.scale, ds->stream.bias);
+        stream_draw(&ds->stream, &ds->rs);
+        rasterizer_resolve_visibility(&ds->rs);
+        rasterizer_resolve_msaa(&ds->rs);
+        ds->rs.functions.present(ds->rs.functions.userdata);
+        return;
+    }
 
-    demo_set_world_matrix(ds, 1);
-    draw_wire_box(ds);
-    //draw_box(ds);
+    // boxes 0 and 3 are solid, 1 and 2 wireframe
+    mat4x4 solid_matrices[2];
+    mat4x4 wire_matrices[2];
+    demo_get_world_matrix(ds, 0, &solid_matrices[0]);
+    demo_get_world_matrix(ds, 1, &wire_matrices[0]);
+    demo_get_world_matrix(ds, 2, &wire_matrices[1]);
+    demo_get_world_matrix(ds, 3, &solid_matrices[1]);
 
-    demo_set_world_matrix(ds, 2);
-    draw_wire_box(ds);
-    //draw_box(ds);
+    // both box meshes fit the unit cube, instances outside the view are skipped
+    static const struct rasterizer_bounds box_bounds = { RASTERIZER_BOUNDS_BOX, { 0.0f, 0.0f, 0.0f }, { 0.5f, 0.5f, 0.5f }, 0.0f };
+    rasterizer_set_bounds(&ds->rs, &box_bounds);
+    draw_boxes(ds, solid_matrices, 2);
+    rasterizer_resolve_visibility(&ds->rs);
+    rasterizer_resolve_msaa(&ds->rs);
 
-    demo_set_world_matrix(ds, 3);
-    //draw_wire_box(ds);
-    draw_box(ds);
+    // the solid boxes are the occluders, wire boxes entirely behind them are skipped
+    rasterizer_build_hiz(&ds->rs);
+    draw_wire_boxes(ds, wire_matrices, 2);
 
-    //rasterizer_draw_line(&ds->rs, 1, 1, 10, 10);
-    //
     ds->rs.functions.present(ds->rs.functions.userdata);
 }
 
@@ -3,6 +3,7 @@
 
 struct demo_state *demo_init(int screenw, int screenh, struct rasterizer_functions *functions);
 void demo_reshape(struct demo_state *ds, int screenw, int screenh);
+int demo_load_mesh(struct demo_state *ds, const char *filename);
 void demo_rotate_up(struct demo_state *ds);
 void demo_rotate_down(struct demo_state *ds);
 void demo_rotate_left(struct demo_state *ds);
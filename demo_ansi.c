@@ -0,0 +1,438 @@
+#include "rasterizer.h"
+#include "demo.h"
+#include "settings.h"
+#include "swapchain.h"
+
+#if defined(USE_ANSI)
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+
+// packs several sub-pixels into each terminal cell and writes 24-bit colour escapes directly,
+// one buffered write per frame. half-block gives 1x2 sub-pixels per cell, braille 2x4.
+enum subcell_mode
+{
+    SUBCELL_HALF_BLOCK,
+    SUBCELL_BRAILLE,
+};
+
+// sentinel for "terminal default colour" in the sgr state tracking
+#define DEFAULT_COLOR (0xFFFFFFFFu)
+
+struct window_data
+{
+    int cols;
+    int rows;
+    int width;
+    int height;
+    enum subcell_mode mode;
+    unsigned int *pixels;
+
+    // with PRESENT_BUFFERS, frames are rendered into the swapchain and written out on its thread
+    int async_present;
+    struct swapchain swapchain;
+
+    char *stream;
+    size_t stream_size;
+    size_t stream_capacity;
+    unsigned int current_fg;
+    unsigned int current_bg;
+
+    struct termios saved_termios;
+    struct demo_state *ds;
+};
+
+// returns -1 if the stream could not grow, it keeps what it had
+static int stream_reserve(struct window_data *wd, size_t count)
+{
+    if ((wd->stream_size + count) <= wd->stream_capacity)
+        return 0;
+
+    size_t capacity = wd->stream_capacity;
+    while ((wd->stream_size + count) > capacity)
+        capacity = (capacity == 0) ? 4096 : (capacity * 2);
+
+    char *stream = (char *)realloc(wd->stream, capacity);
+    if (stream == NULL)
+        return -1;
+
+    wd->stream = stream;
+    wd->stream_capacity = capacity;
+    return 0;
+}
+
+// text which does not fit is dropped, the next frame repositions the cursor and resets the colours anyway
+static void stream_append(struct window_data *wd, const char *str, size_t len)
+{
+    if (stream_reserve(wd, len) != 0)
+        return;
+
+    memcpy(wd->stream + wd->stream_size, str, len);
+    wd->stream_size += len;
+}
+
+#define STREAM_APPEND_LITERAL(wd, str) stream_append((wd), (str), sizeof(str) - 1)
+
+static void stream_append_uint(struct window_data *wd, unsigned int value)
+{
+    char buf[10];
+    int len = 0;
+    do
+    {
+        buf[sizeof(buf) - 1 - len++] = (char)('0' + (value % 10));
+        value /= 10;
+    } while (value != 0);
+
+    stream_append(wd, buf + sizeof(buf) - len, len);
+}
+
+static void stream_set_color(struct window_data *wd, unsigned int *current, unsigned int color, int background)
+{
+    if (*current == color)
+        return;
+
+    *current = color;
+    if (color == DEFAULT_COLOR)
+    {
+        if (background)
+            STREAM_APPEND_LITERAL(wd, "\x1b[49m");
+        else
+            STREAM_APPEND_LITERAL(wd, "\x1b[39m");
+        return;
+    }
+
+    if (background)
+        STREAM_APPEND_LITERAL(wd, "\x1b[48;2;");
+    else
+        STREAM_APPEND_LITERAL(wd, "\x1b[38;2;");
+    stream_append_uint(wd, color & 0xFF);
+    STREAM_APPEND_LITERAL(wd, ";");
+    stream_append_uint(wd, (color >> 8) & 0xFF);
+    STREAM_APPEND_LITERAL(wd, ";");
+    stream_append_uint(wd, (color >> 16) & 0xFF);
+    STREAM_APPEND_LITERAL(wd, "m");
+}
+
+static void stream_flush(struct window_data *wd)
+{
+    size_t written = 0;
+    while (written < wd->stream_size)
+    {
+        ssize_t result = write(STDOUT_FILENO, wd->stream + written, wd->stream_size - written);
+        if (result <= 0)
+            break;
+
+        written += (size_t)result;
+    }
+
+    wd->stream_size = 0;
+}
+
+// returns -1 if memory could not be allocated, leaving the old framebuffer and layout in place
+static int resize_framebuffer(struct window_data *wd, int cols, int rows)
+{
+    int width = (wd->mode == SUBCELL_BRAILLE) ? (cols * 2) : cols;
+    int height = (wd->mode == SUBCELL_BRAILLE) ? (rows * 4) : (rows * 2);
+    unsigned int *pixels = (unsigned int *)realloc(wd->pixels, sizeof(unsigned int) * (size_t)width * (size_t)height);
+    if (pixels == NULL)
+        return -1;
+
+    wd->pixels = pixels;
+    wd->cols = cols;
+    wd->rows = rows;
+    wd->width = width;
+    wd->height = height;
+    memset(wd->pixels, 0, sizeof(unsigned int) * (size_t)wd->width * (size_t)wd->height);
+    STREAM_APPEND_LITERAL(wd, "\x1b[0m\x1b[2J");
+    return 0;
+}
+
+static void get_terminal_size(int *cols, int *rows)
+{
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 || ws.ws_row == 0)
+    {
+        *cols = 80;
+        *rows = 24;
+        return;
+    }
+
+    *cols = ws.ws_col;
+    *rows = ws.ws_row;
+}
+
+static void demo_ansi_clear(void *userdata)
+{
+    struct window_data *wd = (struct window_data *)userdata;
+
+    memset(wd->pixels, 0, sizeof(unsigned int) * (size_t)wd->width * (size_t)wd->height);
+}
+
+static void demo_ansi_set_pixel(void *userdata, int x, int y, unsigned int color)
+{
+    struct window_data *wd = (struct window_data *)userdata;
+    if (x < 0 || x >= wd->width || y < 0 || y >= wd->height)
+        return;
+
+    // cleared pixels are zero, drawn pixels always have alpha set
+    wd->pixels[y * wd->width + x] = color | 0xFF000000;
+}
+
+static unsigned int demo_ansi_get_pixel(void *userdata, int x, int y)
+{
+    struct window_data *wd = (struct window_data *)userdata;
+    if (x < 0 || x >= wd->width || y < 0 || y >= wd->height)
+        return 0;
+
+    return wd->pixels[y * wd->width + x];
+}
+
+static void present_half_block(struct window_data *wd, const unsigned int *pixels, int stride, int row, int cols)
+{
+    const unsigned int *top = pixels + (row * 2) * stride;
+    const unsigned int *bottom = top + stride;
+    for (int col = 0; col < cols; col++)
+    {
+        unsigned int upper = top[col];
+        unsigned int lower = bottom[col];
+        if (upper != 0)
+        {
+            // upper half block, lower pixel is the background
+            stream_set_color(wd, &wd->current_fg, upper & 0xFFFFFF, 0);
+            stream_set_color(wd, &wd->current_bg, (lower != 0) ? (lower & 0xFFFFFF) : DEFAULT_COLOR, 1);
+            STREAM_APPEND_LITERAL(wd, "\xe2\x96\x80");
+        }
+        else if (lower != 0)
+        {
+            stream_set_color(wd, &wd->current_fg, lower & 0xFFFFFF, 0);
+            stream_set_color(wd, &wd->current_bg, DEFAULT_COLOR, 1);
+            STREAM_APPEND_LITERAL(wd, "\xe2\x96\x84");
+        }
+        else
+        {
+            stream_set_color(wd, &wd->current_bg, DEFAULT_COLOR, 1);
+            STREAM_APPEND_LITERAL(wd, " ");
+        }
+    }
+}
+
+static void present_braille(struct window_data *wd, const unsigned int *pixels, int stride, int row, int cols)
+{
+    // dot numbering of the unicode braille block, indexed [y][x] within the cell
+    static const unsigned char dot_bits[4][2] = { { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 } };
+
+    const unsigned int *base = pixels + (row * 4) * stride;
+    for (int col = 0; col < cols; col++)
+    {
+        // a cell only has one foreground colour, so average the lit dots
+        unsigned int bits = 0;
+        unsigned int count = 0;
+        unsigned int r = 0, g = 0, b = 0;
+        for (int dy = 0; dy < 4; dy++)
+        {
+            const unsigned int *line = base + dy * stride + col * 2;
+            for (int dx = 0; dx < 2; dx++)
+            {
+                unsigned int color = line[dx];
+                if (color == 0)
+                    continue;
+
+                bits |= dot_bits[dy][dx];
+                r += color & 0xFF;
+                g += (color >> 8) & 0xFF;
+                b += (color >> 16) & 0xFF;
+                count++;
+            }
+        }
+
+        stream_set_color(wd, &wd->current_bg, DEFAULT_COLOR, 1);
+        if (count == 0)
+        {
+            STREAM_APPEND_LITERAL(wd, " ");
+            continue;
+        }
+
+        stream_set_color(wd, &wd->current_fg, (r / count) | ((g / count) << 8) | ((b / count) << 16), 0);
+
+        char glyph[3] = { (char)0xe2, (char)(0xa0 | (bits >> 6)), (char)(0x80 | (bits & 0x3F)) };
+        stream_append(wd, glyph, 3);
+    }
+}
+
+static void demo_ansi_present_pixels(void *userdata, const unsigned int *pixels, int width, int height)
+{
+    struct window_data *wd = (struct window_data *)userdata;
+
+    // the terminal keeps colours between frames, so start from a known state
+    wd->current_fg = DEFAULT_COLOR;
+    wd->current_bg = DEFAULT_COLOR;
+    STREAM_APPEND_LITERAL(wd, "\x1b[0m");
+
+    // cells covered by the buffer, which is sized by whoever presents it rather than by the current terminal
+    int braille = (wd->mode == SUBCELL_BRAILLE);
+    int cols = braille ? (width / 2) : width;
+    int rows = height / (braille ? 4 : 2);
+    for (int row = 0; row < rows; row++)
+    {
+        // explicit positioning avoids depending on the terminal's autowrap behaviour
+        STREAM_APPEND_LITERAL(wd, "\x1b[");
+        stream_append_uint(wd, (unsigned int)row + 1);
+        STREAM_APPEND_LITERAL(wd, ";1H");
+
+        if (wd->mode == SUBCELL_BRAILLE)
+            present_braille(wd, pixels, width, row, cols);
+        else
+            present_half_block(wd, pixels, width, row, cols);
+    }
+
+    stream_flush(wd);
+}
+
+static void demo_ansi_present(void *userdata)
+{
+    struct window_data *wd = (struct window_data *)userdata;
+
+    demo_ansi_present_pixels(wd, wd->pixels, wd->width, wd->height);
+}
+
+static int read_key(int timeout_ms)
+{
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) <= 0)
+        return -1;
+
+    unsigned char buf[8];
+    ssize_t len = read(STDIN_FILENO, buf, sizeof(buf));
+    if (len <= 0)
+        return -1;
+
+    // arrow keys arrive as ESC [ A..D
+    if (len >= 3 && buf[0] == 0x1b && buf[1] == '[')
+        return 0x100 | buf[2];
+
+    return buf[0];
+}
+
+// leaves the alternate screen, restores the terminal settings and frees the window
+static void shutdown_terminal(struct window_data *wd)
+{
+    STREAM_APPEND_LITERAL(wd, "\x1b[0m\x1b[?25h\x1b[?1049l");
+    stream_flush(wd);
+    tcsetattr(STDIN_FILENO, TCSANOW, &wd->saved_termios);
+
+    free(wd->stream);
+    free(wd->pixels);
+    free(wd);
+}
+
+int main(int argc, char *argv[])
+{
+    struct window_data *wd = (struct window_data *)calloc(1, sizeof(struct window_data));
+    if (wd == NULL)
+        return 1;
+
+    wd->mode = ANSI_SUBCELL_BRAILLE ? SUBCELL_BRAILLE : SUBCELL_HALF_BLOCK;
+
+    // raw, non-echoing input
+    struct termios raw;
+    tcgetattr(STDIN_FILENO, &wd->saved_termios);
+    raw = wd->saved_termios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+
+    // alternate screen, hidden cursor
+    STREAM_APPEND_LITERAL(wd, "\x1b[?1049h\x1b[?25l");
+
+    int cols, rows;
+    get_terminal_size(&cols, &rows);
+    if (resize_framebuffer(wd, cols, rows) != 0)
+    {
+        shutdown_terminal(wd);
+        return 1;
+    }
+
+    struct rasterizer_functions rsf;
+    wd->async_present = (PRESENT_BUFFERS != 0 && swapchain_init(&wd->swapchain, wd->width, wd->height, PRESENT_BUFFERS, demo_ansi_present_pixels, wd) == 0);
+    if (wd->async_present)
+    {
+        swapchain_get_functions(&wd->swapchain, &rsf);
+    }
+    else
+    {
+        rsf.clear = demo_ansi_clear;
+        rsf.set_pixel = demo_ansi_set_pixel;
+        rsf.present = demo_ansi_present;
+        rsf.get_pixel = demo_ansi_get_pixel;
+        rsf.userdata = wd;
+    }
+
+    wd->ds = demo_init(wd->width, wd->height, &rsf);
+
+    // optional binary mesh (see meshconv) to draw instead of the boxes
+    if (argc > 1)
+        demo_load_mesh(wd->ds, argv[1]);
+
+    for (;;)
+    {
+        int ch = read_key(SLEEP_TIME);
+        if (ch == (0x100 | 'A'))
+            demo_rotate_up(wd->ds);
+        else if (ch == (0x100 | 'B'))
+            demo_rotate_down(wd->ds);
+        else if (ch == (0x100 | 'D'))
+            demo_rotate_left(wd->ds);
+        else if (ch == (0x100 | 'C'))
+            demo_rotate_right(wd->ds);
+        else if (ch == 'q')
+            break;
+
+        enum subcell_mode mode = wd->mode;
+        if (ch == 'm')
+            mode = (mode == SUBCELL_BRAILLE) ? SUBCELL_HALF_BLOCK : SUBCELL_BRAILLE;
+
+        get_terminal_size(&cols, &rows);
+        if (mode != wd->mode || cols != wd->cols || rows != wd->rows)
+        {
+            // the present thread reads the layout and the stream, so let it finish before changing them
+            if (wd->async_present)
+                swapchain_destroy(&wd->swapchain);
+
+            wd->mode = mode;
+            if (resize_framebuffer(wd, cols, rows) != 0)
+            {
+                wd->async_present = 0;
+                break;
+            }
+
+            if (wd->async_present && swapchain_init(&wd->swapchain, wd->width, wd->height, PRESENT_BUFFERS, demo_ansi_present_pixels, wd) != 0)
+            {
+                wd->async_present = 0;
+                break;
+            }
+
+            demo_reshape(wd->ds, wd->width, wd->height);
+        }
+
+        demo_frame(wd->ds);
+    }
+
+    if (wd->async_present)
+        swapchain_destroy(&wd->swapchain);
+
+    shutdown_terminal(wd);
+    return 0;
+}
+
+#endif
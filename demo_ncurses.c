@@ -1,24 +1,111 @@
 #include "rasterizer.h"
 #include "demo.h"
+#include "dither.h"
 #include "settings.h"
 
 #if defined(USE_NCURSES)
 
 #include <ncurses.h>
 #include <unistd.h>
+#include <string.h>
+
+// cells hold palette indices, DITHER_TRANSPARENT for nothing drawn
+#define CELL_EMPTY DITHER_TRANSPARENT
+#define CELL_INVALID (0xFE)
 
 struct window_data
 {
     int width;
     int height;
+    unsigned int *pixels;
+    unsigned char *cells;
+    unsigned char *prev_cells;
+    int *dither_errors;
+    enum dither_mode dither_mode;
     struct demo_state *ds;
 };
 
+// glyph + attributes written for each cell value
+static chtype cell_glyphs[256];
+
+// what the colour pairs actually look like, so quantization and dithering know the error they make
+static struct dither_palette palette;
+
+static void build_palette(void)
+{
+#if USE_NCURSES_COLOR
+    // entry i is drawn with colour pair i + 1, apart from the last, black, which is a blank cell
+    static const unsigned int pair_colors[] =
+    {
+        MAKE_COLOR_R8G8B8_UNORM(205, 0, 0),         // COLOR_RED
+        MAKE_COLOR_R8G8B8_UNORM(0, 205, 0),         // COLOR_GREEN
+        MAKE_COLOR_R8G8B8_UNORM(205, 205, 0),       // COLOR_YELLOW
+        MAKE_COLOR_R8G8B8_UNORM(0, 0, 238),         // COLOR_BLUE
+        MAKE_COLOR_R8G8B8_UNORM(205, 0, 205),       // COLOR_MAGENTA
+        MAKE_COLOR_R8G8B8_UNORM(0, 205, 205),       // COLOR_CYAN
+        MAKE_COLOR_R8G8B8_UNORM(229, 229, 229),     // COLOR_WHITE
+        MAKE_COLOR_R8G8B8_UNORM(0, 0, 0),           // blank
+    };
+
+    dither_palette_init(&palette, pair_colors, sizeof(pair_colors) / sizeof(pair_colors[0]));
+    for (int i = 0; i < palette.ncolors - 1; i++)
+        cell_glyphs[i] = '*' | COLOR_PAIR(i + 1);
+    cell_glyphs[palette.ncolors - 1] = ' ' | COLOR_PAIR(0);
+#else
+    static const unsigned int mono_colors[] = { MAKE_COLOR_R8G8B8_UNORM(255, 255, 255) };
+    dither_palette_init(&palette, mono_colors, 1);
+    cell_glyphs[0] = '*';
+#endif
+
+    cell_glyphs[CELL_EMPTY] = ' ';
+}
+
+// returns -1 if memory could not be allocated, the buffers which did grow are kept so they are still freed
+static int resize_cells(struct window_data *wd, int width, int height)
+{
+    size_t size = (size_t)width * (size_t)height;
+    unsigned int *pixels = (unsigned int *)realloc(wd->pixels, sizeof(unsigned int) * size);
+    if (pixels != NULL)
+        wd->pixels = pixels;
+    unsigned char *cells = (unsigned char *)realloc(wd->cells, size);
+    if (cells != NULL)
+        wd->cells = cells;
+    unsigned char *prev_cells = (unsigned char *)realloc(wd->prev_cells, size);
+    if (prev_cells != NULL)
+        wd->prev_cells = prev_cells;
+    int *dither_errors = (int *)realloc(wd->dither_errors, sizeof(int) * DITHER_DIFFUSION_ERRORS(width));
+    if (dither_errors != NULL)
+        wd->dither_errors = dither_errors;
+    if (pixels == NULL || cells == NULL || prev_cells == NULL || dither_errors == NULL)
+        return -1;
+
+    wd->width = width;
+    wd->height = height;
+    memset(wd->pixels, 0, sizeof(unsigned int) * size);
+
+    // force every cell to be emitted on the next present
+    memset(wd->prev_cells, CELL_INVALID, size);
+    clear();
+    return 0;
+}
+
+static void free_cells(struct window_data *wd)
+{
+    if (wd == NULL)
+        return;
+
+    free(wd->pixels);
+    free(wd->prev_cells);
+    free(wd->cells);
+    free(wd->dither_errors);
+    free(wd);
+}
+
 static void demo_ncurses_clear(void *userdata)
 {
     struct window_data *wd = (struct window_data *)userdata;
 
-    clear();
+    memset(wd->pixels, 0, sizeof(unsigned int) * (size_t)wd->width * (size_t)wd->height);
 }
 
 static void demo_ncurses_set_pixel(void *userdata, int x, int y, unsigned int color)
@@ -27,32 +114,52 @@ static void demo_ncurses_set_pixel(void *userdata, int x, int y, unsigned int co
     if (x < 0 || x >= wd->width || y < 0 || y >= wd->height)
         return;
 
-#if USE_NCURSES_COLOR
-    unsigned int r = (color & 0xFF);
-    unsigned int g = (color >> 8) & 0xFF;
-    unsigned int b = (color >> 16) & 0xFF;
-    int color_pair = 0;
-    if (r > g && r > b)
-        color_pair = (r > 127) ? COLOR_MAGENTA : COLOR_RED;
-    else if (g > b)
-        color_pair = (g > 127) ? COLOR_YELLOW : COLOR_GREEN;
-    else
-        color_pair = (b > 127) ? COLOR_CYAN : COLOR_BLUE;
-
-    attron(COLOR_PAIR(color_pair));
-    mvaddch(y, x, '*');
-    attroff(COLOR_PAIR(color_pair));
-#else
-    mvaddch(y, x, '*');
-#endif
+    // cleared pixels are zero, drawn pixels always have alpha set
+    wd->pixels[y * wd->width + x] = color | 0xFF000000;
+}
 
-    //usleep(200);
-    //refresh();
+static unsigned int demo_ncurses_get_pixel(void *userdata, int x, int y)
+{
+    struct window_data *wd = (struct window_data *)userdata;
+    if (x < 0 || x >= wd->width || y < 0 || y >= wd->height)
+        return 0;
+
+    return wd->pixels[y * wd->width + x];
 }
 
 static void demo_ncurses_present(void *userdata)
 {
     struct window_data *wd = (struct window_data *)userdata;
+
+    // reduce to the pair palette, then only touch cells which differ from the last frame, one hline per run of equal cells
+    dither_image(&palette, wd->dither_mode, wd->pixels, wd->width, wd->cells, wd->width, wd->width, wd->height, wd->dither_errors);
+    for (int y = 0; y < wd->height; y++)
+    {
+        const unsigned char *row = wd->cells + y * wd->width;
+        const unsigned char *prev_row = wd->prev_cells + y * wd->width;
+        int x = 0;
+        while (x < wd->width)
+        {
+            if (row[x] == prev_row[x])
+            {
+                x++;
+                continue;
+            }
+
+            unsigned char cell = row[x];
+            int start = x;
+            while (x < wd->width && row[x] == cell)
+                x++;
+
+            mvhline(y, start, cell_glyphs[cell], x - start);
+        }
+    }
+
+    // this frame becomes the reference for the next one
+    unsigned char *temp = wd->prev_cells;
+    wd->prev_cells = wd->cells;
+    wd->cells = temp;
+
     refresh();
 }
 
@@ -72,6 +179,7 @@ int main(int argc, char *argv[])
     init_pair(COLOR_CYAN, COLOR_CYAN, COLOR_BLACK);
     init_pair(COLOR_WHITE, COLOR_WHITE, COLOR_BLACK);
 #endif
+    build_palette();
 
     noecho();
     nodelay(stdscr, TRUE);
@@ -79,17 +187,28 @@ int main(int argc, char *argv[])
 
     halfdelay(1);
 
-    struct window_data *wd = (struct window_data *)malloc(sizeof(struct window_data));
-    wd->width = getmaxx(stdscr);
-    wd->height = getmaxy(stdscr);
+    struct window_data *wd = (struct window_data *)calloc(1, sizeof(struct window_data));
+    if (wd == NULL || resize_cells(wd, getmaxx(stdscr), getmaxy(stdscr)) != 0)
+    {
+        free_cells(wd);
+        endwin();
+        return 1;
+    }
+
+    wd->dither_mode = (enum dither_mode)NCURSES_DITHER_MODE;
 
     struct rasterizer_functions rsf;
     rsf.clear = demo_ncurses_clear;
     rsf.set_pixel = demo_ncurses_set_pixel;
     rsf.present = demo_ncurses_present;
+    rsf.get_pixel = demo_ncurses_get_pixel;
     rsf.userdata = wd;
     wd->ds = demo_init(wd->width, wd->height, &rsf);
 
+    // optional binary mesh (see meshconv) to draw instead of the boxes
+    if (argc > 1)
+        demo_load_mesh(wd->ds, argv[1]);
+
     refresh();
 
     for (;;)
@@ -103,6 +222,8 @@ int main(int argc, char *argv[])
             demo_rotate_left(wd->ds);
         else if (ch == KEY_RIGHT)
             demo_rotate_right(wd->ds);
+        else if (ch == 'd')
+            wd->dither_mode = (enum dither_mode)((wd->dither_mode + 1) % DITHER_MODE_COUNT);
         else if (ch == 'q')
             break;
 
@@ -110,8 +231,8 @@ int main(int argc, char *argv[])
         int height = getmaxy(stdscr);
         if (width != wd->width || height != wd->height)
         {
-            wd->width = width;
-            wd->height = height;
+            if (resize_cells(wd, width, height) != 0)
+                break;
             demo_reshape(wd->ds, wd->width, wd->height);
         }
 
@@ -119,7 +240,7 @@ int main(int argc, char *argv[])
         //usleep(SLEEP_TIME * 1000);
     }
 
-    free(wd);
+    free_cells(wd);
     endwin();
     return 0;
 }
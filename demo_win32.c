@@ -34,6 +34,12 @@ static void demo_win32_set_pixel(void *userdata, int x, int y, unsigned int colo
     SetPixel(wd->hdc, x, y, color & 0x00FFFFFF);
 }
 
+static unsigned int demo_win32_get_pixel(void *userdata, int x, int y)
+{
+    struct window_data *wd = (struct window_data *)userdata;
+    return (unsigned int)GetPixel(wd->hdc, x, y) & 0x00FFFFFF;
+}
+
 static void demo_win32_present(void *userdata)
 {
     struct window_data *wd = (struct window_data *)userdata;
@@ -68,6 +74,7 @@ static void init_window(HWND hwnd)
     rsf.clear = demo_win32_clear;
     rsf.set_pixel = demo_win32_set_pixel;
     rsf.present = demo_win32_present;
+    rsf.get_pixel = demo_win32_get_pixel;
     rsf.userdata = wd;
     wd->ds = demo_init(wd->win_width, wd->win_height, &rsf);
     
@@ -269,6 +276,7 @@ int main(int argc, char *argv[])
     rsf.clear = demo_win32_clear;
     rsf.set_pixel = demo_win32_set_pixel;
     rsf.present = demo_win32_present;
+    rsf.get_pixel = NULL;
     rsf.userdata = wd;
     wd->ds = demo_init(wd->width, wd->height, &rsf);
 
@@ -0,0 +1,217 @@
+#include "dither.h"
+#include "simd.h"
+#include <math.h>
+#include <string.h>
+
+// 4x4 bayer threshold matrix
+static const int bayer4x4[4][4] =
+{
+    { 0, 8, 2, 10 },
+    { 12, 4, 14, 6 },
+    { 3, 11, 1, 9 },
+    { 15, 7, 13, 5 },
+};
+
+static unsigned int dither_lut_index(unsigned int color)
+{
+    return ((color >> 4) & 0x00F) | ((color >> 8) & 0x0F0) | ((color >> 12) & 0xF00);
+}
+
+static int dither_clamp(int value)
+{
+    return (value < 0) ? 0 : ((value > 255) ? 255 : value);
+}
+
+void dither_palette_init(struct dither_palette *palette, const unsigned int *colors, int ncolors)
+{
+    if (ncolors > (int)(sizeof(palette->colors) / sizeof(palette->colors[0])))
+        ncolors = (int)(sizeof(palette->colors) / sizeof(palette->colors[0]));
+
+    memcpy(palette->colors, colors, sizeof(unsigned int) * ncolors);
+    palette->ncolors = ncolors;
+
+    // assume the palette is spread roughly evenly over the colour cube
+    int levels = (int)ceilf(cbrtf((float)ncolors));
+    palette->spread = 255 / ((levels > 2) ? (levels - 1) : 1);
+
+    // nearest entry by squared distance, evaluated at the centre of each 4:4:4 bucket
+    for (unsigned int index = 0; index < 4096; index++)
+    {
+        int r = (int)(index & 0xF) * 17;
+        int g = (int)((index >> 4) & 0xF) * 17;
+        int b = (int)((index >> 8) & 0xF) * 17;
+        int best = 0;
+        int best_distance = 0x7FFFFFFF;
+        for (int i = 0; i < ncolors; i++)
+        {
+            int dr = r - (int)(colors[i] & 0xFF);
+            int dg = g - (int)((colors[i] >> 8) & 0xFF);
+            int db = b - (int)((colors[i] >> 16) & 0xFF);
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < best_distance)
+            {
+                best = i;
+                best_distance = distance;
+            }
+        }
+
+        palette->lut[index] = (unsigned char)best;
+    }
+}
+
+void dither_palette_init_rgb332(struct dither_palette *palette)
+{
+    // index 255 is reserved for DITHER_TRANSPARENT, so white is lost, which is the usual trade-off
+    unsigned int colors[255];
+    for (unsigned int i = 0; i < 255; i++)
+    {
+        unsigned int r = ((i >> 5) & 0x7) * 255 / 7;
+        unsigned int g = ((i >> 2) & 0x7) * 255 / 7;
+        unsigned int b = (i & 0x3) * 255 / 3;
+        colors[i] = (r) | (g << 8) | (b << 16) | 0xFF000000;
+    }
+
+    dither_palette_init(palette, colors, 255);
+    palette->spread = 255 / 7;
+}
+
+void dither_quantize_row(const struct dither_palette *palette, const unsigned int *src, unsigned char *dst, int width)
+{
+    for (int x = 0; x < width; x++)
+        dst[x] = ((src[x] >> 24) == 0) ? DITHER_TRANSPARENT : palette->lut[dither_lut_index(src[x])];
+}
+
+void dither_ordered_row(const struct dither_palette *palette, const unsigned int *src, unsigned char *dst, int width, int y)
+{
+    // the pattern repeats every four pixels, so one row of offsets covers exactly four rgba pixels.
+    // offsets are split into a positive and a negative part so they can be applied with saturating byte math.
+    unsigned char pos_bias[16];
+    unsigned char neg_bias[16];
+    for (int i = 0; i < 4; i++)
+    {
+        int offset = ((bayer4x4[y & 3][i] * 2 - 15) * palette->spread) / 32;
+        unsigned char pos = (unsigned char)((offset > 0) ? offset : 0);
+        unsigned char neg = (unsigned char)((offset < 0) ? -offset : 0);
+        pos_bias[i * 4 + 0] = pos_bias[i * 4 + 1] = pos_bias[i * 4 + 2] = pos;
+        neg_bias[i * 4 + 0] = neg_bias[i * 4 + 1] = neg_bias[i * 4 + 2] = neg;
+        pos_bias[i * 4 + 3] = neg_bias[i * 4 + 3] = 0;
+    }
+
+    int x = 0;
+
+#if defined(USE_SSE2)
+    __m128i pos = _mm_loadu_si128((const __m128i *)pos_bias);
+    __m128i neg = _mm_loadu_si128((const __m128i *)neg_bias);
+    __m128i mask_r = _mm_set1_epi32(0x00F);
+    __m128i mask_g = _mm_set1_epi32(0x0F0);
+    __m128i mask_b = _mm_set1_epi32(0xF00);
+    __m128i zero = _mm_setzero_si128();
+    for (; (x + 4) <= width; x += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i biased = _mm_subs_epu8(_mm_adds_epu8(pixels, pos), neg);
+
+        __m128i index = _mm_and_si128(_mm_srli_epi32(biased, 4), mask_r);
+        index = _mm_or_si128(index, _mm_and_si128(_mm_srli_epi32(biased, 8), mask_g));
+        index = _mm_or_si128(index, _mm_and_si128(_mm_srli_epi32(biased, 12), mask_b));
+
+        // flag zero-alpha pixels by pushing their index past the table
+        __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(pixels, 24), zero);
+        index = _mm_or_si128(index, _mm_and_si128(transparent, _mm_set1_epi32(0x1000)));
+
+        unsigned int indices[4];
+        _mm_storeu_si128((__m128i *)indices, index);
+        for (int i = 0; i < 4; i++)
+            dst[x + i] = (indices[i] & 0x1000) ? DITHER_TRANSPARENT : palette->lut[indices[i]];
+    }
+#endif
+
+    for (; x < width; x++)
+    {
+        unsigned int color = src[x];
+        if ((color >> 24) == 0)
+        {
+            dst[x] = DITHER_TRANSPARENT;
+            continue;
+        }
+
+        const unsigned char *pb = pos_bias + (x & 3) * 4;
+        const unsigned char *nb = neg_bias + (x & 3) * 4;
+        int r = dither_clamp((int)(color & 0xFF) + pb[0] - nb[0]);
+        int g = dither_clamp((int)((color >> 8) & 0xFF) + pb[1] - nb[1]);
+        int b = dither_clamp((int)((color >> 16) & 0xFF) + pb[2] - nb[2]);
+        dst[x] = palette->lut[dither_lut_index((unsigned int)r | ((unsigned int)g << 8) | ((unsigned int)b << 16))];
+    }
+}
+
+void dither_diffusion_begin(struct dither_diffusion_state *state, int width, int *errors)
+{
+    // two rows of rgb error, padded by one pixel on each side so the kernel never needs bounds checks
+    state->width = width;
+    state->y = 0;
+    state->errors = errors;
+    memset(errors, 0, sizeof(int) * DITHER_DIFFUSION_ERRORS(width));
+}
+
+void dither_diffusion_row(struct dither_diffusion_state *state, const struct dither_palette *palette, const unsigned int *src, unsigned char *dst)
+{
+    // floyd-steinberg, errors are kept in 1/16ths. rows alternate direction to avoid directional artifacts.
+    int stride = (state->width + 2) * 3;
+    int *current = state->errors + (state->y & 1) * stride + 3;
+    int *next = state->errors + ((state->y + 1) & 1) * stride + 3;
+    int dir = (state->y & 1) ? -1 : 1;
+    int x = (dir > 0) ? 0 : (state->width - 1);
+
+    memset(next - 3, 0, sizeof(int) * stride);
+    for (int i = 0; i < state->width; i++, x += dir)
+    {
+        unsigned int color = src[x];
+        int *err = current + x * 3;
+        if ((color >> 24) == 0)
+        {
+            dst[x] = DITHER_TRANSPARENT;
+            continue;
+        }
+
+        int value[3];
+        value[0] = dither_clamp((int)(color & 0xFF) + err[0] / 16);
+        value[1] = dither_clamp((int)((color >> 8) & 0xFF) + err[1] / 16);
+        value[2] = dither_clamp((int)((color >> 16) & 0xFF) + err[2] / 16);
+
+        unsigned char index = palette->lut[dither_lut_index((unsigned int)value[0] | ((unsigned int)value[1] << 8) | ((unsigned int)value[2] << 16))];
+        unsigned int chosen = palette->colors[index];
+        dst[x] = index;
+
+        for (int c = 0; c < 3; c++)
+        {
+            int e = value[c] - (int)((chosen >> (c * 8)) & 0xFF);
+            err[dir * 3 + c] += e * 7;
+            next[(x - dir) * 3 + c] += e * 3;
+            next[x * 3 + c] += e * 5;
+            next[(x + dir) * 3 + c] += e;
+        }
+    }
+
+    state->y++;
+}
+
+void dither_image(const struct dither_palette *palette, enum dither_mode mode, const unsigned int *src, int src_stride, unsigned char *dst, int dst_stride, int width, int height, int *errors)
+{
+    if (mode == DITHER_FLOYD_STEINBERG)
+    {
+        struct dither_diffusion_state state;
+        dither_diffusion_begin(&state, width, errors);
+        for (int y = 0; y < height; y++)
+            dither_diffusion_row(&state, palette, src + y * src_stride, dst + y * dst_stride);
+    }
+    else if (mode == DITHER_ORDERED)
+    {
+        for (int y = 0; y < height; y++)
+            dither_ordered_row(palette, src + y * src_stride, dst + y * dst_stride, width, y);
+    }
+    else
+    {
+        for (int y = 0; y < height; y++)
+            dither_quantize_row(palette, src + y * src_stride, dst + y * dst_stride, width);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdlib.h>
+
+// written for pixels with zero alpha (never drawn), these are not dithered
+#define DITHER_TRANSPARENT (0xFF)
+
+enum dither_mode
+{
+    DITHER_NONE,
+    DITHER_ORDERED,
+    DITHER_FLOYD_STEINBERG,
+    DITHER_MODE_COUNT,
+};
+
+struct dither_palette
+{
+    unsigned int colors[255];
+    int ncolors;
+
+    // amplitude of the ordered dither pattern, roughly the distance between palette entries
+    int spread;
+
+    // nearest palette entry for each 4:4:4 quantized colour
+    unsigned char lut[4096];
+};
+
+// error diffusion only needs the current and next row of errors, so images can be streamed a row at a time. the errors
+// belong to the caller, DITHER_DIFFUSION_ERRORS(width) ints, so they can be kept from one image to the next.
+#define DITHER_DIFFUSION_ERRORS(width) ((size_t)((width) + 2) * 3 * 2)
+
+struct dither_diffusion_state
+{
+    int width;
+    int y;
+    int *errors;
+};
+
+void dither_palette_init(struct dither_palette *palette, const unsigned int *colors, int ncolors);
+void dither_palette_init_rgb332(struct dither_palette *palette);
+
+void dither_quantize_row(const struct dither_palette *palette, const unsigned int *src, unsigned char *dst, int width);
+void dither_ordered_row(const struct dither_palette *palette, const unsigned int *src, unsigned char *dst, int width, int y);
+
+void dither_diffusion_begin(struct dither_diffusion_state *state, int width, int *errors);
+void dither_diffusion_row(struct dither_diffusion_state *state, const struct dither_palette *palette, const unsigned int *src, unsigned char *dst);
+
+// errors is only used by DITHER_FLOYD_STEINBERG, and can be NULL for the other modes
+void dither_image(const struct dither_palette *palette, enum dither_mode mode, const unsigned int *src, int src_stride, unsigned char *dst, int dst_stride, int width, int height, int *errors);
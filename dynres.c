@@ -0,0 +1,295 @@
+#include "dynres.h"
+#include "simd.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// largest change of the scale per frame. dropping is faster than recovering, an over-budget frame is felt
+// immediately while a slightly soft one is not.
+#define DYNRES_MAX_STEP_DOWN (0.1f)
+#define DYNRES_MAX_STEP_UP (0.05f)
+
+// changes smaller than this are ignored, so the size settles instead of wobbling with the timer noise
+#define DYNRES_MIN_STEP (1.0f / 32.0f)
+
+#define DYNRES_DEFAULT_MIN_SCALE (0.25f)
+
+static double dynres_get_time_ms(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+#endif
+}
+
+static void dynres_free(struct dynres *dr)
+{
+    free(dr->pixels);
+    free(dr->column_x0);
+    free(dr->column_x1);
+    free(dr->column_weight);
+    free(dr->row);
+    dr->pixels = NULL;
+    dr->column_x0 = NULL;
+    dr->column_x1 = NULL;
+    dr->column_weight = NULL;
+    dr->row = NULL;
+}
+
+// maps output coordinate i to the source, pixel centres to pixel centres, in 16.16
+static int dynres_map(int i, int source_size, int output_size)
+{
+    long long step = ((long long)source_size << 16) / output_size;
+    long long position = (long long)i * step + step / 2 - (1 << 15);
+    return (position < 0) ? 0 : (int)position;
+}
+
+static void dynres_update_size(struct dynres *dr)
+{
+    dr->width = (int)((float)dr->output_width * dr->scale + 0.5f);
+    dr->height = (int)((float)dr->output_height * dr->scale + 0.5f);
+    dr->width = (dr->width < 1) ? 1 : ((dr->width > dr->output_width) ? dr->output_width : dr->width);
+    dr->height = (dr->height < 1) ? 1 : ((dr->height > dr->output_height) ? dr->output_height : dr->height);
+
+    // nearest filtering is bilinear with a zero weight on the right column
+    for (int x = 0; x < dr->output_width; x++)
+    {
+        if (dr->filter == DYNRES_FILTER_NEAREST)
+        {
+            int source_x = (int)(((long long)(x * 2 + 1) * dr->width) / (dr->output_width * 2));
+            dr->column_x0[x] = dr->column_x1[x] = source_x;
+            dr->column_weight[x] = 0;
+            continue;
+        }
+
+        int position = dynres_map(x, dr->width, dr->output_width);
+        int x0 = position >> 16;
+        x0 = (x0 > dr->width - 1) ? (dr->width - 1) : x0;
+        dr->column_x0[x] = x0;
+        dr->column_x1[x] = (x0 + 1 < dr->width) ? (x0 + 1) : x0;
+        dr->column_weight[x] = (position >> 8) & 0xFF;
+    }
+}
+
+int dynres_init(struct dynres *dr, int output_width, int output_height, const struct rasterizer_functions *output, float budget_ms, enum dynres_filter filter)
+{
+    memset(dr, 0, sizeof(*dr));
+    dr->scale = 1.0f;
+    dr->min_scale = DYNRES_DEFAULT_MIN_SCALE;
+    dr->budget_ms = budget_ms;
+    dr->filter = filter;
+    dr->average_ms = -1.0f;
+    dr->output = *output;
+    return dynres_resize(dr, output_width, output_height);
+}
+
+void dynres_destroy(struct dynres *dr)
+{
+    dynres_free(dr);
+    memset(dr, 0, sizeof(*dr));
+}
+
+int dynres_resize(struct dynres *dr, int output_width, int output_height)
+{
+    dynres_free(dr);
+    dr->output_width = output_width;
+    dr->output_height = output_height;
+    dr->width = dr->height = 0;
+    if (output_width <= 0 || output_height <= 0)
+        return -1;
+
+    dr->pixels = (unsigned int *)malloc(sizeof(unsigned int) * (size_t)output_width * (size_t)output_height);
+    dr->column_x0 = (int *)malloc(sizeof(int) * (size_t)output_width);
+    dr->column_x1 = (int *)malloc(sizeof(int) * (size_t)output_width);
+    dr->column_weight = (int *)malloc(sizeof(int) * (size_t)output_width);
+    dr->row = (unsigned int *)malloc(sizeof(unsigned int) * (size_t)output_width);
+    if (dr->pixels == NULL || dr->column_x0 == NULL || dr->column_x1 == NULL || dr->column_weight == NULL || dr->row == NULL)
+    {
+        dynres_free(dr);
+        return -1;
+    }
+
+    memset(dr->pixels, 0, sizeof(unsigned int) * (size_t)output_width * (size_t)output_height);
+    dynres_update_size(dr);
+    return 0;
+}
+
+// render cost goes with the pixel count, ie. the square of the scale
+static void dynres_update_scale(struct dynres *dr, float frame_ms)
+{
+    // the average keeps a single slow frame from throwing the scale around
+    dr->average_ms = (dr->average_ms < 0.0f) ? frame_ms : (dr->average_ms * 0.75f + frame_ms * 0.25f);
+    if (dr->budget_ms <= 0.0f || dr->average_ms <= 0.0f)
+        return;
+
+    float target = dr->scale * sqrtf(dr->budget_ms / dr->average_ms);
+    target = fmaxf(target, dr->scale - DYNRES_MAX_STEP_DOWN);
+    target = fminf(target, dr->scale + DYNRES_MAX_STEP_UP);
+    target = fminf(fmaxf(target, dr->min_scale), 1.0f);
+
+    // always reach the bounds exactly, even when the step there is small
+    if (fabsf(target - dr->scale) >= DYNRES_MIN_STEP || target == 1.0f || target == dr->min_scale)
+        dr->scale = target;
+}
+
+void dynres_begin_frame(struct dynres *dr, struct viewport_state *viewport)
+{
+    int width = dr->width;
+    int height = dr->height;
+    if (dr->pixels != NULL)
+    {
+        dynres_update_size(dr);
+
+        // the previous frame's pixels are outside or misplaced in the new size
+        if (dr->width != width || dr->height != height)
+            memset(dr->pixels, 0, sizeof(unsigned int) * (size_t)dr->output_width * (size_t)dr->output_height);
+    }
+
+    viewport->top_left_x = 0;
+    viewport->top_left_y = 0;
+    viewport->width = dr->width;
+    viewport->height = dr->height;
+    dr->frame_start = dynres_get_time_ms();
+}
+
+static void dynres_clear(void *userdata)
+{
+    struct dynres *dr = (struct dynres *)userdata;
+    if (dr->pixels != NULL)
+        memset(dr->pixels, 0, sizeof(unsigned int) * (size_t)dr->output_width * (size_t)dr->height);
+}
+
+static void dynres_set_pixel(void *userdata, int x, int y, unsigned int color)
+{
+    struct dynres *dr = (struct dynres *)userdata;
+    if (x < 0 || x >= dr->width || y < 0 || y >= dr->height)
+        return;
+
+    // cleared pixels are zero, drawn pixels always have alpha set
+    dr->pixels[y * dr->output_width + x] = color | 0xFF000000;
+}
+
+static unsigned int dynres_get_pixel(void *userdata, int x, int y)
+{
+    struct dynres *dr = (struct dynres *)userdata;
+    if (x < 0 || x >= dr->width || y < 0 || y >= dr->height)
+        return 0;
+
+    return dr->pixels[y * dr->output_width + x];
+}
+
+// one output row from source rows top and bottom, weight is bottom's share in 1/256ths. cleared pixels blend in as
+// transparent black, which the caller uses to keep silhouettes where they are.
+static void dynres_filter_row(const struct dynres *dr, unsigned int *dst, const unsigned int *top, const unsigned int *bottom, int weight)
+{
+#if defined(USE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i top_weight = _mm_set1_epi16((short)(256 - weight));
+    const __m128i bottom_weight = _mm_set1_epi16((short)weight);
+    for (int x = 0; x < dr->output_width; x++)
+    {
+        int x0 = dr->column_x0[x];
+        int x1 = dr->column_x1[x];
+        int right = dr->column_weight[x];
+
+        // left pixel's channels in the low four words, right pixel's in the high four
+        __m128i t = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)top[x0]), _mm_cvtsi32_si128((int)top[x1])), zero);
+        __m128i b = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)bottom[x0]), _mm_cvtsi32_si128((int)bottom[x1])), zero);
+
+        // the weights sum to 256, so neither the products nor their sums leave 16 bits
+        __m128i column = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(t, top_weight), _mm_mullo_epi16(b, bottom_weight)), 8);
+        __m128i horizontal = _mm_unpacklo_epi64(_mm_set1_epi16((short)(256 - right)), _mm_set1_epi16((short)right));
+        __m128i sum = _mm_mullo_epi16(column, horizontal);
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_srli_si128(sum, 8)), 8);
+        dst[x] = (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(sum, zero));
+    }
+#else
+    for (int x = 0; x < dr->output_width; x++)
+    {
+        unsigned int tl = top[dr->column_x0[x]];
+        unsigned int tr = top[dr->column_x1[x]];
+        unsigned int bl = bottom[dr->column_x0[x]];
+        unsigned int br = bottom[dr->column_x1[x]];
+        unsigned int right = (unsigned int)dr->column_weight[x];
+        unsigned int color = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            unsigned int left_column = (((tl >> shift) & 0xFF) * (unsigned int)(256 - weight) + ((bl >> shift) & 0xFF) * (unsigned int)weight) >> 8;
+            unsigned int right_column = (((tr >> shift) & 0xFF) * (unsigned int)(256 - weight) + ((br >> shift) & 0xFF) * (unsigned int)weight) >> 8;
+            color |= ((left_column * (256 - right) + right_column * right) >> 8) << shift;
+        }
+
+        dst[x] = color;
+    }
+#endif
+}
+
+static void dynres_present(void *userdata)
+{
+    struct dynres *dr = (struct dynres *)userdata;
+    if (dr->pixels == NULL)
+    {
+        dr->output.present(dr->output.userdata);
+        return;
+    }
+
+    // the upscale costs the same at any scale, so it is left out of the measurement
+    dynres_update_scale(dr, (float)(dynres_get_time_ms() - dr->frame_start));
+
+    dr->output.clear(dr->output.userdata);
+    for (int y = 0; y < dr->output_height; y++)
+    {
+        const unsigned int *top;
+        const unsigned int *bottom;
+        int weight;
+        if (dr->filter == DYNRES_FILTER_NEAREST)
+        {
+            int source_y = (int)(((long long)(y * 2 + 1) * dr->height) / (dr->output_height * 2));
+            top = bottom = dr->pixels + source_y * dr->output_width;
+            weight = 0;
+        }
+        else
+        {
+            int position = dynres_map(y, dr->height, dr->output_height);
+            int y0 = position >> 16;
+            y0 = (y0 > dr->height - 1) ? (dr->height - 1) : y0;
+            top = dr->pixels + y0 * dr->output_width;
+            weight = (position >> 8) & 0xFF;
+            bottom = (y0 + 1 < dr->height && weight != 0) ? (top + dr->output_width) : top;
+        }
+
+        if (dr->width == dr->output_width && top == bottom)
+            memcpy(dr->row, top, sizeof(unsigned int) * (size_t)dr->output_width);
+        else
+            dynres_filter_row(dr, dr->row, top, bottom, weight);
+
+        // pixels mostly covered by cleared ones stay cleared, so bilinear filtering doesn't grow a dark fringe
+        for (int x = 0; x < dr->output_width; x++)
+        {
+            if (dr->row[x] >= 0x80000000)
+                dr->output.set_pixel(dr->output.userdata, x, y, dr->row[x]);
+        }
+    }
+
+    dr->output.present(dr->output.userdata);
+}
+
+void dynres_get_functions(struct dynres *dr, struct rasterizer_functions *functions)
+{
+    functions->clear = dynres_clear;
+    functions->set_pixel = dynres_set_pixel;
+    functions->present = dynres_present;
+    functions->get_pixel = dynres_get_pixel;
+    functions->userdata = dr;
+}
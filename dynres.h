@@ -0,0 +1,57 @@
+#pragma once
+#include "rasterizer.h"
+
+// dynamic resolution: frames are rendered into an internal target whose size follows a frame-time budget, and
+// upscaled to the output when presented. the scale drops quickly when frames run over budget, and creeps back up
+// once there is headroom, so latency stays steady under load without the resolution flickering every frame.
+enum dynres_filter
+{
+    DYNRES_FILTER_NEAREST,
+    DYNRES_FILTER_BILINEAR
+};
+
+struct dynres
+{
+    int output_width;
+    int output_height;
+
+    // current internal size, output size times scale
+    int width;
+    int height;
+    float scale;
+
+    // bounds of the scale, min_scale can be changed after init
+    float min_scale;
+    float budget_ms;
+    enum dynres_filter filter;
+
+    // average of the measured render times, negative until the first frame has been measured
+    float average_ms;
+    double frame_start;
+
+    // internal target, allocated at the output size (with the output's stride) so scale changes never reallocate
+    unsigned int *pixels;
+
+    // per output column: left source column, right source column and weight of the right one in 1/256ths
+    int *column_x0;
+    int *column_x1;
+    int *column_weight;
+    unsigned int *row;
+
+    // where upscaled frames go
+    struct rasterizer_functions output;
+};
+
+// budget_ms is the render time to aim for, from the start of a frame to its present. returns 0 on success, -1 if
+// memory could not be allocated.
+int dynres_init(struct dynres *dr, int output_width, int output_height, const struct rasterizer_functions *output, float budget_ms, enum dynres_filter filter);
+void dynres_destroy(struct dynres *dr);
+
+// the scale is kept, the internal size follows the new output size
+int dynres_resize(struct dynres *dr, int output_width, int output_height);
+
+// starts timing a frame and returns the viewport to render it at, which only changes between frames
+void dynres_begin_frame(struct dynres *dr, struct viewport_state *viewport);
+
+// clear, set_pixel and get_pixel work on the internal target, present upscales it to the output and presents that
+void dynres_get_functions(struct dynres *dr, struct rasterizer_functions *functions);
@@ -0,0 +1,39 @@
+#pragma once
+#include "minimath.h"
+
+// 16.16 fixed point, used instead of float throughout the per-vertex and per-pixel work when the library is built with
+// RASTERIZER_FIXED_POINT=1, for targets without an fpu. everything is integer arithmetic with defined rounding, so the
+// output is the same on every platform (right shifts of negative values are assumed to be arithmetic, as they are on
+// every compiler this builds with). the api still takes floats, those are converted once per draw, or with integer
+// operations only where it has to happen per vertex.
+typedef int fixed;
+
+#define FIXED_SHIFT (16)
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+#define FIXED_FROM_INT(i) ((fixed)((i) * FIXED_ONE))
+#define FIXED_FLOOR(f) ((int)((f) >> FIXED_SHIFT))
+#define FIXED_MUL(a, b) ((fixed)(((long long)(a) * (long long)(b)) >> FIXED_SHIFT))
+
+typedef struct
+{
+    fixed x, y, z, w;
+} fixed_vec4;
+
+typedef struct
+{
+    fixed data[4][4];
+} fixed_mat4x4;
+
+// truncates towards zero and saturates, decoding the float's bits rather than using the fpu
+fixed fixed_from_float(float f);
+float fixed_to_float(fixed f);
+
+// angle in degrees, from a quarter-wave table with linear interpolation in between
+fixed fixed_sin(fixed degrees);
+fixed fixed_cos(fixed degrees);
+
+fixed_mat4x4 *fixed_mat4x4_from_mat4x4(fixed_mat4x4 *dst, const mat4x4 *src);
+
+// w of the vector is taken to be one, the result is in 32.32 so the perspective divide keeps its precision
+void fixed_mat4x4_mul_point(long long dst[4], const fixed_mat4x4 *lhs, const fixed_vec4 *rhs);
@@ -0,0 +1,249 @@
+#include "job_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// returns zero if the queue is full and could not grow
+static int job_queue_push(struct job_queue *queue, const struct job *job)
+{
+    mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity)
+    {
+        // unwrap into the larger ring, oldest job first
+        unsigned int capacity = (queue->capacity == 0) ? 64 : (queue->capacity * 2);
+        struct job *jobs = (struct job *)malloc(sizeof(struct job) * capacity);
+        if (jobs == NULL)
+        {
+            mutex_unlock(&queue->lock);
+            return 0;
+        }
+
+        for (unsigned int i = 0; i < queue->count; i++)
+            jobs[i] = queue->jobs[(queue->head + i) % queue->capacity];
+
+        free(queue->jobs);
+        queue->jobs = jobs;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+
+    queue->jobs[(queue->head + queue->count) % queue->capacity] = *job;
+    queue->count++;
+    mutex_unlock(&queue->lock);
+    return 1;
+}
+
+// newest first from the back for the owner, which still has its data in cache, oldest first from the front for thieves
+static int job_queue_pop(struct job_queue *queue, int steal, struct job *job)
+{
+    mutex_lock(&queue->lock);
+    if (queue->count == 0)
+    {
+        mutex_unlock(&queue->lock);
+        return 0;
+    }
+
+    if (steal)
+    {
+        *job = queue->jobs[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+    }
+    else
+    {
+        *job = queue->jobs[(queue->head + queue->count - 1) % queue->capacity];
+    }
+
+    queue->count--;
+    mutex_unlock(&queue->lock);
+    return 1;
+}
+
+// own queue first (worker < 0 for threads outside the pool), then the others starting from the next one along
+static int job_pool_take(struct job_pool *pool, int worker, struct job *job)
+{
+    if (worker >= 0 && job_queue_pop(&pool->queues[worker], 0, job))
+        return 1;
+
+    int start = (worker >= 0) ? (worker + 1) : 0;
+    for (int i = 0; i < pool->nqueues; i++)
+    {
+        int victim = (start + i) % pool->nqueues;
+        if (victim != worker && job_queue_pop(&pool->queues[victim], 1, job))
+            return 1;
+    }
+
+    return 0;
+}
+
+// called without the lock, the job has already been taken out of its queue
+static void job_pool_execute(struct job_pool *pool, const struct job *job)
+{
+    mutex_lock(&pool->lock);
+    pool->queued--;
+    mutex_unlock(&pool->lock);
+
+    job->fn(job->context, job->index);
+
+    mutex_lock(&pool->lock);
+    if (--job->group->pending == 0)
+        condition_broadcast(&pool->changed);
+    mutex_unlock(&pool->lock);
+}
+
+struct job_worker_start
+{
+    struct job_pool *pool;
+    int worker;
+};
+
+static void job_pool_worker(void *arg)
+{
+    struct job_pool *pool = ((struct job_worker_start *)arg)->pool;
+    int worker = ((struct job_worker_start *)arg)->worker;
+    free(arg);
+
+    for (;;)
+    {
+        struct job job;
+        if (job_pool_take(pool, worker, &job))
+        {
+            job_pool_execute(pool, &job);
+            continue;
+        }
+
+        // nothing anywhere, sleep until something is submitted
+        mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->quit)
+            condition_wait(&pool->changed, &pool->lock);
+
+        int quit = pool->quit;
+        mutex_unlock(&pool->lock);
+        if (quit)
+            break;
+    }
+}
+
+int job_pool_init(struct job_pool *pool, int nthreads)
+{
+    memset(pool, 0, sizeof(*pool));
+    mutex_init(&pool->lock);
+    condition_init(&pool->changed);
+
+    nthreads = (nthreads < JOB_POOL_MAX_THREADS) ? nthreads : JOB_POOL_MAX_THREADS;
+    pool->nqueues = (nthreads > 0) ? nthreads : 1;
+    for (int i = 0; i < pool->nqueues; i++)
+        mutex_init(&pool->queues[i].lock);
+
+    // queues of workers which failed to start are still drained by the others
+    for (int i = 0; i < nthreads; i++)
+    {
+        struct job_worker_start *start = (struct job_worker_start *)malloc(sizeof(struct job_worker_start));
+        if (start == NULL)
+            break;
+
+        start->pool = pool;
+        start->worker = i;
+        if (thread_create(&pool->threads[pool->nthreads], job_pool_worker, start) != 0)
+        {
+            free(start);
+            break;
+        }
+
+        pool->nthreads++;
+    }
+
+    if (nthreads > 0 && pool->nthreads == 0)
+    {
+        job_pool_destroy(pool);
+        return -1;
+    }
+
+    return 0;
+}
+
+void job_pool_destroy(struct job_pool *pool)
+{
+    mutex_lock(&pool->lock);
+    pool->quit = 1;
+    condition_broadcast(&pool->changed);
+    mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++)
+        thread_join(&pool->threads[i]);
+
+    for (int i = 0; i < pool->nqueues; i++)
+    {
+        free(pool->queues[i].jobs);
+        mutex_destroy(&pool->queues[i].lock);
+    }
+
+    condition_destroy(&pool->changed);
+    mutex_destroy(&pool->lock);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void job_group_init(struct job_group *group)
+{
+    group->pending = 0;
+}
+
+void job_pool_submit(struct job_pool *pool, struct job_group *group, job_fn fn, void *context, unsigned int index)
+{
+    struct job job;
+    job.fn = fn;
+    job.context = context;
+    job.index = index;
+    job.group = group;
+
+    // counted before it becomes visible, so the group can never appear finished early
+    mutex_lock(&pool->lock);
+    group->pending++;
+    unsigned int queue = pool->next_queue++ % (unsigned int)pool->nqueues;
+    if (!job_queue_push(&pool->queues[queue], &job))
+    {
+        // out of memory, run it here instead
+        group->pending--;
+        mutex_unlock(&pool->lock);
+        fn(context, index);
+        return;
+    }
+
+    pool->queued++;
+    condition_signal(&pool->changed);
+    mutex_unlock(&pool->lock);
+}
+
+void job_pool_wait(struct job_pool *pool, struct job_group *group)
+{
+    for (;;)
+    {
+        mutex_lock(&pool->lock);
+        unsigned int pending = group->pending;
+        mutex_unlock(&pool->lock);
+        if (pending == 0)
+            return;
+
+        // help out rather than sit idle
+        struct job job;
+        if (job_pool_take(pool, -1, &job))
+        {
+            job_pool_execute(pool, &job);
+            continue;
+        }
+
+        // the rest is running elsewhere, sleep until something finishes or is submitted
+        mutex_lock(&pool->lock);
+        while (group->pending != 0 && pool->queued == 0)
+            condition_wait(&pool->changed, &pool->lock);
+        mutex_unlock(&pool->lock);
+    }
+}
+
+void job_pool_run(struct job_pool *pool, job_fn fn, void *context, unsigned int count)
+{
+    struct job_group group;
+    job_group_init(&group);
+    for (unsigned int i = 0; i < count; i++)
+        job_pool_submit(pool, &group, fn, context, i);
+
+    job_pool_wait(pool, &group);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "thread.h"
+
+#define JOB_POOL_MAX_THREADS (32)
+
+typedef void(*job_fn)(void *context, unsigned int index);
+
+struct job
+{
+    job_fn fn;
+    void *context;
+    unsigned int index;
+    struct job_group *group;
+};
+
+// double-ended queue of jobs. its worker takes the newest job from the back, idle threads steal the oldest from the front.
+struct job_queue
+{
+    struct mutex lock;
+    struct job *jobs;
+    unsigned int head;
+    unsigned int count;
+    unsigned int capacity;
+};
+
+// counts the unfinished jobs of one submitter, so it can wait for its own work only
+struct job_group
+{
+    unsigned int pending;
+};
+
+// work-stealing pool, safe to share between any number of submitting threads (for example one render context each).
+// jobs are spread over the workers' queues, and every thread which waits on a group runs queued jobs meanwhile.
+struct job_pool
+{
+    int nthreads;
+    struct thread threads[JOB_POOL_MAX_THREADS];
+
+    // one per worker, or a single one run by waiting threads if there are no workers
+    struct job_queue queues[JOB_POOL_MAX_THREADS];
+    int nqueues;
+
+    // protects queued, next_queue, quit and every group's pending count
+    struct mutex lock;
+    struct condition changed;
+    unsigned int queued;
+    unsigned int next_queue;
+    int quit;
+};
+
+// starts nthreads workers, 0 runs every job on the threads which wait for them.
+// returns 0 on success, -1 if no thread could be started.
+int job_pool_init(struct job_pool *pool, int nthreads);
+
+// the pool must be idle, jobs still queued are dropped
+void job_pool_destroy(struct job_pool *pool);
+
+void job_group_init(struct job_group *group);
+
+// queues fn(context, index), which may run on any thread, in any order relative to other jobs. if the queue cannot
+// grow, runs it on the calling thread instead.
+void job_pool_submit(struct job_pool *pool, struct job_group *group, job_fn fn, void *context, unsigned int index);
+
+// returns once every job submitted to the group has finished, running queued jobs (of any group) while waiting.
+// jobs may submit and wait themselves.
+void job_pool_wait(struct job_pool *pool, struct job_group *group);
+
+// runs fn(context, index) for each index in [0, count) and waits for all of them
+void job_pool_run(struct job_pool *pool, job_fn fn, void *context, unsigned int count);
@@ -0,0 +1,757 @@
+#include "mesh.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// size of the lru cache modelled by the optimizer, larger than most real caches to stay cache-size agnostic
+#define MESH_CACHE_SIZE (32)
+#define MESH_NO_TRIANGLE ((size_t)-1)
+
+struct obj_vertex
+{
+    float position[3];
+    unsigned int color;
+};
+
+static float mesh_vertex_score(int cache_position, unsigned int remaining)
+{
+    // vertices with no triangles left are never wanted again
+    if (remaining == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cache_position >= 0)
+    {
+        // the last triangle's vertices get a fixed score so the next triangle does not just reuse them all
+        if (cache_position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (float)(cache_position - 3) / (float)(MESH_CACHE_SIZE - 3), 1.5f);
+    }
+
+    // boost vertices with few triangles left, so they get finished off rather than left as stragglers
+    return score + 2.0f / sqrtf((float)remaining);
+}
+
+int mesh_optimize_vertex_cache(unsigned int *indices, size_t nindices, size_t nverts)
+{
+    size_t ntris = nindices / 3;
+    if (ntris == 0)
+        return 0;
+
+    unsigned int *offsets = (unsigned int *)calloc(nverts + 1, sizeof(unsigned int));
+    unsigned int *remaining = (unsigned int *)calloc(nverts, sizeof(unsigned int));
+    unsigned int *adjacency = (unsigned int *)malloc(sizeof(unsigned int) * ntris * 3);
+    int *cache_position = (int *)malloc(sizeof(int) * nverts);
+    float *vertex_score = (float *)malloc(sizeof(float) * nverts);
+    float *triangle_score = (float *)malloc(sizeof(float) * ntris);
+    unsigned char *emitted = (unsigned char *)calloc(ntris, 1);
+    unsigned int *output = (unsigned int *)malloc(sizeof(unsigned int) * ntris * 3);
+    if (offsets == NULL || remaining == NULL || adjacency == NULL || cache_position == NULL || vertex_score == NULL ||
+        triangle_score == NULL || emitted == NULL || output == NULL)
+    {
+        free(output);
+        free(emitted);
+        free(triangle_score);
+        free(vertex_score);
+        free(cache_position);
+        free(adjacency);
+        free(remaining);
+        free(offsets);
+        return -1;
+    }
+
+    // triangles using each vertex, the first remaining[v] entries of a vertex's range are still to be emitted
+    for (size_t i = 0; i < ntris * 3; i++)
+        offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < nverts; v++)
+        offsets[v + 1] += offsets[v];
+    for (size_t i = 0; i < ntris * 3; i++)
+    {
+        unsigned int v = indices[i];
+        adjacency[offsets[v] + remaining[v]++] = (unsigned int)(i / 3);
+    }
+
+    for (size_t v = 0; v < nverts; v++)
+    {
+        cache_position[v] = -1;
+        vertex_score[v] = mesh_vertex_score(-1, remaining[v]);
+    }
+
+    size_t best = 0;
+    for (size_t t = 0; t < ntris; t++)
+    {
+        triangle_score[t] = vertex_score[indices[t * 3 + 0]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+        if (triangle_score[t] > triangle_score[best])
+            best = t;
+    }
+
+    unsigned int cache[MESH_CACHE_SIZE + 3];
+    int cache_count = 0;
+    size_t scan_position = 0;
+    for (size_t count = 0; count < ntris; count++)
+    {
+        // nothing adjacent to the cache, fall back to the next unused triangle in input order
+        if (best == MESH_NO_TRIANGLE)
+        {
+            while (emitted[scan_position])
+                scan_position++;
+            best = scan_position;
+        }
+
+        const unsigned int *tri = indices + best * 3;
+        memcpy(output + count * 3, tri, sizeof(unsigned int) * 3);
+        emitted[best] = 1;
+
+        for (int i = 0; i < 3; i++)
+        {
+            unsigned int v = tri[i];
+            unsigned int *list = adjacency + offsets[v];
+            for (unsigned int j = 0; j < remaining[v]; j++)
+            {
+                if (list[j] == best)
+                {
+                    list[j] = list[remaining[v] - 1];
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+
+        // the new triangle goes to the front of the cache, anything past the end falls out
+        unsigned int new_cache[MESH_CACHE_SIZE + 3];
+        int new_count = 0;
+        for (int i = 0; i < 3; i++)
+            new_cache[new_count++] = tri[i];
+        for (int i = 0; i < cache_count; i++)
+        {
+            if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                new_cache[new_count++] = cache[i];
+        }
+
+        for (int i = 0; i < new_count; i++)
+        {
+            unsigned int v = new_cache[i];
+            cache_position[v] = (i < MESH_CACHE_SIZE) ? i : -1;
+            vertex_score[v] = mesh_vertex_score(cache_position[v], remaining[v]);
+        }
+
+        cache_count = (new_count < MESH_CACHE_SIZE) ? new_count : MESH_CACHE_SIZE;
+        memcpy(cache, new_cache, sizeof(unsigned int) * cache_count);
+
+        // only triangles touching the cache changed score
+        float best_score = -1.0f;
+        best = MESH_NO_TRIANGLE;
+        for (int i = 0; i < cache_count; i++)
+        {
+            unsigned int v = cache[i];
+            const unsigned int *list = adjacency + offsets[v];
+            for (unsigned int j = 0; j < remaining[v]; j++)
+            {
+                unsigned int t = list[j];
+                triangle_score[t] = vertex_score[indices[t * 3 + 0]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    memcpy(indices, output, sizeof(unsigned int) * ntris * 3);
+
+    free(output);
+    free(emitted);
+    free(triangle_score);
+    free(vertex_score);
+    free(cache_position);
+    free(adjacency);
+    free(remaining);
+    free(offsets);
+    return 0;
+}
+
+// below this the normals spread over nearly a hemisphere, and the cone would hardly ever cull anything
+#define MESH_CONE_MIN_DOT (0.1f)
+
+static void mesh_meshlet_bounds(struct rasterizer_meshlet *meshlet, const float *positions, const unsigned int *indices)
+{
+    const unsigned int *tri_indices = indices + meshlet->first_index;
+    float bounds_min[3] = { 3.402823466e+38f, 3.402823466e+38f, 3.402823466e+38f };
+    float bounds_max[3] = { -3.402823466e+38f, -3.402823466e+38f, -3.402823466e+38f };
+    for (unsigned int i = 0; i < meshlet->triangle_count * 3; i++)
+    {
+        const float *p = positions + (size_t)tri_indices[i] * 3;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bounds_min[axis] = fminf(bounds_min[axis], p[axis]);
+            bounds_max[axis] = fmaxf(bounds_max[axis], p[axis]);
+        }
+    }
+
+    // sphere around the box centre, looser than the minimal one but only ever tested against
+    float radius_sq = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+        meshlet->center[axis] = (bounds_min[axis] + bounds_max[axis]) * 0.5f;
+    for (unsigned int i = 0; i < meshlet->triangle_count * 3; i++)
+    {
+        const float *p = positions + (size_t)tri_indices[i] * 3;
+        float dx = p[0] - meshlet->center[0], dy = p[1] - meshlet->center[1], dz = p[2] - meshlet->center[2];
+        radius_sq = fmaxf(radius_sq, dx * dx + dy * dy + dz * dz);
+    }
+
+    meshlet->radius = sqrtf(radius_sq);
+
+    // unit normals, counter-clockwise triangles face along them. degenerate triangles have none and are never drawn.
+    float normals[RASTERIZER_MESHLET_MAX_TRIANGLES][3];
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    unsigned int nnormals = 0;
+    for (unsigned int t = 0; t < meshlet->triangle_count; t++)
+    {
+        const float *p0 = positions + (size_t)tri_indices[t * 3 + 0] * 3;
+        const float *p1 = positions + (size_t)tri_indices[t * 3 + 1] * 3;
+        const float *p2 = positions + (size_t)tri_indices[t * 3 + 2] * 3;
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0f)
+            continue;
+
+        for (int i = 0; i < 3; i++)
+        {
+            normals[nnormals][i] = n[i] / length;
+            axis[i] += normals[nnormals][i];
+        }
+
+        nnormals++;
+    }
+
+    float axis_length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    meshlet->cone_cutoff = 1.0f;
+    memset(meshlet->cone_axis, 0, sizeof(meshlet->cone_axis));
+    if (nnormals == 0 || axis_length == 0.0f)
+        return;
+
+    float min_dot = 1.0f;
+    for (int i = 0; i < 3; i++)
+        axis[i] /= axis_length;
+    for (unsigned int t = 0; t < nnormals; t++)
+        min_dot = fminf(min_dot, normals[t][0] * axis[0] + normals[t][1] * axis[1] + normals[t][2] * axis[2]);
+
+    if (min_dot <= MESH_CONE_MIN_DOT)
+        return;
+
+    memcpy(meshlet->cone_axis, axis, sizeof(meshlet->cone_axis));
+    meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+struct rasterizer_meshlet *mesh_build_meshlets(const float *positions, size_t nverts, const unsigned int *indices, size_t nindices, unsigned int *out_count)
+{
+    // never more meshlets than triangles
+    size_t ntris = nindices / 3;
+    struct rasterizer_meshlet *meshlets = (struct rasterizer_meshlet *)malloc(sizeof(struct rasterizer_meshlet) * (ntris > 0 ? ntris : 1));
+    unsigned int *owner = (unsigned int *)malloc(sizeof(unsigned int) * (nverts > 0 ? nverts : 1));
+    *out_count = 0;
+    if (meshlets == NULL || owner == NULL)
+    {
+        free(meshlets);
+        free(owner);
+        return NULL;
+    }
+
+    // greedy, in index order: a triangle joins the current meshlet unless it would take it past a limit. after
+    // mesh_optimize_vertex_cache neighbouring triangles are close together, so the meshlets come out compact.
+    memset(owner, 0xFF, sizeof(unsigned int) * nverts);
+    unsigned int count = 0;
+    unsigned int meshlet_verts = 0;
+    meshlets[0].first_index = 0;
+    meshlets[0].triangle_count = 0;
+    for (size_t t = 0; t < ntris; t++)
+    {
+        const unsigned int *tri = indices + t * 3;
+        unsigned int new_verts = (owner[tri[0]] != count) +
+                                 (owner[tri[1]] != count && tri[1] != tri[0]) +
+                                 (owner[tri[2]] != count && tri[2] != tri[0] && tri[2] != tri[1]);
+        if (meshlets[count].triangle_count == RASTERIZER_MESHLET_MAX_TRIANGLES || (meshlet_verts + new_verts) > RASTERIZER_MESHLET_MAX_VERTICES)
+        {
+            mesh_meshlet_bounds(&meshlets[count], positions, indices);
+            count++;
+            meshlets[count].first_index = (unsigned int)(t * 3);
+            meshlets[count].triangle_count = 0;
+            meshlet_verts = 0;
+            new_verts = 1 + (tri[1] != tri[0]) + (tri[2] != tri[0] && tri[2] != tri[1]);
+        }
+
+        for (int i = 0; i < 3; i++)
+            owner[tri[i]] = count;
+
+        meshlet_verts += new_verts;
+        meshlets[count].triangle_count++;
+    }
+
+    if (ntris > 0)
+    {
+        mesh_meshlet_bounds(&meshlets[count], positions, indices);
+        count++;
+    }
+
+    free(owner);
+    *out_count = count;
+    return meshlets;
+}
+
+static char *mesh_read_file(const char *filename, size_t *size)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (length < 0)
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    char *data = (char *)malloc((size_t)length + 1);
+    if (data != NULL && fread(data, 1, (size_t)length, fp) != (size_t)length)
+    {
+        free(data);
+        data = NULL;
+    }
+    else if (data != NULL)
+    {
+        data[length] = '\0';
+        *size = (size_t)length;
+    }
+
+    fclose(fp);
+    return data;
+}
+
+static int mesh_obj_index(const char *token, size_t nverts, unsigned int *index)
+{
+    // v, v/vt, v//vn or v/vt/vn, negative values count back from the last vertex
+    long value = strtol(token, NULL, 10);
+    if (value < 0)
+        value += (long)nverts;
+    else
+        value -= 1;
+
+    if (value < 0 || (size_t)value >= nverts)
+        return -1;
+
+    *index = (unsigned int)value;
+    return 0;
+}
+
+static unsigned int mesh_unorm_channel(float value)
+{
+    return (value <= 0.0f) ? 0 : ((value >= 1.0f) ? 255 : (unsigned int)(value * 255.0f + 0.5f));
+}
+
+static int mesh_parse_obj(char *text, struct obj_vertex **out_verts, size_t *out_nverts, unsigned int **out_indices, size_t *out_nindices)
+{
+    struct obj_vertex *verts = NULL;
+    unsigned int *indices = NULL;
+    size_t nverts = 0, vert_capacity = 0;
+    size_t nindices = 0, index_capacity = 0;
+    int result = 0;
+
+    for (char *line = strtok(text, "\r\n"); line != NULL; line = strtok(NULL, "\r\n"))
+    {
+        while (*line == ' ' || *line == '\t')
+            line++;
+
+        if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+        {
+            if (nverts == vert_capacity)
+            {
+                size_t capacity = (vert_capacity == 0) ? 1024 : (vert_capacity * 2);
+                struct obj_vertex *grown = (struct obj_vertex *)realloc(verts, sizeof(struct obj_vertex) * capacity);
+                if (grown == NULL)
+                {
+                    result = -1;
+                    break;
+                }
+
+                verts = grown;
+                vert_capacity = capacity;
+            }
+
+            // optional trailing r g b is a common extension
+            float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+            char *cursor = line + 1;
+            for (int i = 0; i < 6; i++)
+            {
+                char *end;
+                float value = strtof(cursor, &end);
+                if (end == cursor)
+                    break;
+
+                values[i] = value;
+                cursor = end;
+            }
+
+            struct obj_vertex *vertex = &verts[nverts++];
+            memcpy(vertex->position, values, sizeof(vertex->position));
+            vertex->color = MAKE_COLOR_R8G8B8_UNORM(mesh_unorm_channel(values[3]), mesh_unorm_channel(values[4]), mesh_unorm_channel(values[5]));
+        }
+        else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+        {
+            // triangulate polygons as a fan around the first corner
+            unsigned int first = 0, previous = 0;
+            int corners = 0;
+            char *cursor = line + 1;
+            for (;;)
+            {
+                while (*cursor == ' ' || *cursor == '\t')
+                    cursor++;
+                if (*cursor == '\0')
+                    break;
+
+                unsigned int index;
+                if (mesh_obj_index(cursor, nverts, &index) != 0)
+                {
+                    result = -1;
+                    break;
+                }
+
+                while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t')
+                    cursor++;
+
+                if (corners >= 2)
+                {
+                    if ((nindices + 3) > index_capacity)
+                    {
+                        size_t capacity = (index_capacity == 0) ? 3072 : (index_capacity * 2);
+                        unsigned int *grown = (unsigned int *)realloc(indices, sizeof(unsigned int) * capacity);
+                        if (grown == NULL)
+                        {
+                            result = -1;
+                            break;
+                        }
+
+                        indices = grown;
+                        index_capacity = capacity;
+                    }
+
+                    indices[nindices++] = first;
+                    indices[nindices++] = previous;
+                    indices[nindices++] = index;
+                }
+                else if (corners == 0)
+                {
+                    first = index;
+                }
+
+                previous = index;
+                corners++;
+            }
+
+            if (result != 0)
+                break;
+        }
+    }
+
+    *out_verts = verts;
+    *out_nverts = nverts;
+    *out_indices = indices;
+    *out_nindices = nindices;
+    return result;
+}
+
+int mesh_convert_obj(const char *obj_filename, const char *mesh_filename)
+{
+    size_t text_size;
+    char *text = mesh_read_file(obj_filename, &text_size);
+    if (text == NULL)
+        return -1;
+
+    struct obj_vertex *obj_verts;
+    unsigned int *indices;
+    size_t nverts, nindices;
+    int result = mesh_parse_obj(text, &obj_verts, &nverts, &indices, &nindices);
+    free(text);
+    if (result != 0 || nindices == 0)
+    {
+        free(obj_verts);
+        free(indices);
+        return -1;
+    }
+
+    // everything below is sized for all the vertices, before unreferenced ones are dropped
+    unsigned int *remap = (unsigned int *)malloc(sizeof(unsigned int) * nverts);
+    struct obj_vertex *ordered = (struct obj_vertex *)malloc(sizeof(struct obj_vertex) * nverts);
+    rasterizer_packed_vertex *packed = (rasterizer_packed_vertex *)malloc(sizeof(rasterizer_packed_vertex) * nverts);
+    float *positions = (float *)malloc(sizeof(float) * 3 * nverts);
+    if (remap == NULL || ordered == NULL || packed == NULL || positions == NULL ||
+        mesh_optimize_vertex_cache(indices, nindices, nverts) != 0)
+    {
+        free(positions);
+        free(packed);
+        free(ordered);
+        free(remap);
+        free(indices);
+        free(obj_verts);
+        return -1;
+    }
+
+    // renumber vertices in order of first use so fetches walk memory forwards, dropping unreferenced ones
+    unsigned int nused = 0;
+    memset(remap, 0xFF, sizeof(unsigned int) * nverts);
+    for (size_t i = 0; i < nindices; i++)
+    {
+        unsigned int v = indices[i];
+        if (remap[v] == 0xFFFFFFFFu)
+        {
+            remap[v] = nused;
+            ordered[nused++] = obj_verts[v];
+        }
+
+        indices[i] = remap[v];
+    }
+
+    // quantize each axis of the bounding box to the full signed 16-bit range
+    struct mesh_file_header header;
+    float bounds_min[3], bounds_max[3];
+    for (int axis = 0; axis < 3; axis++)
+        bounds_min[axis] = bounds_max[axis] = ordered[0].position[axis];
+    for (unsigned int v = 1; v < nused; v++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bounds_min[axis] = fminf(bounds_min[axis], ordered[v].position[axis]);
+            bounds_max[axis] = fmaxf(bounds_max[axis], ordered[v].position[axis]);
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float half_extent = (bounds_max[axis] - bounds_min[axis]) * 0.5f;
+        header.bias[axis] = (bounds_min[axis] + bounds_max[axis]) * 0.5f;
+        header.scale[axis] = (half_extent > 0.0f) ? (half_extent / 32767.0f) : 1.0f;
+    }
+
+    for (unsigned int v = 0; v < nused; v++)
+    {
+        short q[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float value = roundf((ordered[v].position[axis] - header.bias[axis]) / header.scale[axis]);
+            q[axis] = (short)((value < -32767.0f) ? -32767.0f : ((value > 32767.0f) ? 32767.0f : value));
+        }
+
+        packed[v].x = q[0];
+        packed[v].y = q[1];
+        packed[v].z = q[2];
+        packed[v].reserved = 0;
+        packed[v].color = ordered[v].color;
+    }
+
+    // meshlet bounds from the quantized positions, which are what gets drawn
+    for (unsigned int v = 0; v < nused; v++)
+    {
+        positions[v * 3 + 0] = (float)packed[v].x * header.scale[0] + header.bias[0];
+        positions[v * 3 + 1] = (float)packed[v].y * header.scale[1] + header.bias[1];
+        positions[v * 3 + 2] = (float)packed[v].z * header.scale[2] + header.bias[2];
+    }
+
+    unsigned int nmeshlets;
+    struct rasterizer_meshlet *meshlets = mesh_build_meshlets(positions, nused, indices, nindices, &nmeshlets);
+    free(positions);
+
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertex_count = nused;
+    header.index_count = (unsigned int)nindices;
+    header.vertex_offset = sizeof(header);
+    header.index_offset = header.vertex_offset + sizeof(rasterizer_packed_vertex) * nused;
+    header.meshlet_count = nmeshlets;
+    header.meshlet_offset = header.index_offset + sizeof(unsigned int) * (unsigned int)nindices;
+
+    FILE *fp = fopen(mesh_filename, "wb");
+    if (meshlets == NULL || fp == NULL ||
+        fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(packed, sizeof(rasterizer_packed_vertex), nused, fp) != nused ||
+        fwrite(indices, sizeof(unsigned int), nindices, fp) != nindices ||
+        fwrite(meshlets, sizeof(struct rasterizer_meshlet), nmeshlets, fp) != nmeshlets)
+    {
+        result = -1;
+    }
+
+    if (fp != NULL && fclose(fp) != 0)
+        result = -1;
+
+    free(meshlets);
+    free(packed);
+    free(ordered);
+    free(remap);
+    free(indices);
+    free(obj_verts);
+    return result;
+}
+
+int mesh_load(struct mesh *mesh, const char *filename)
+{
+    memset(mesh, 0, sizeof(*mesh));
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return -1;
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &file_size))
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    // the view keeps the mapping alive after the handles are closed
+    void *base = (mapping != NULL) ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    CloseHandle(file);
+    if (base == NULL)
+        return -1;
+
+    size_t size = (size_t)file_size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+
+    size_t size = (size_t)st.st_size;
+#endif
+
+    mesh->map_base = base;
+    mesh->map_size = size;
+
+    // only the header is checked, the arrays are used in place and their contents trusted
+    const struct mesh_file_header *header = (const struct mesh_file_header *)base;
+    size_t header_size = offsetof(struct mesh_file_header, meshlet_count);
+    if (size >= header_size && header->version >= 2)
+        header_size = sizeof(*header);
+    if (size < header_size ||
+        header->magic != MESH_FILE_MAGIC || header->version < 1 || header->version > MESH_FILE_VERSION ||
+        (header->vertex_offset % 4) != 0 || (header->index_offset % 4) != 0 ||
+        header->vertex_offset > size || (size - header->vertex_offset) / sizeof(rasterizer_packed_vertex) < header->vertex_count ||
+        header->index_offset > size || (size - header->index_offset) / sizeof(unsigned int) < header->index_count ||
+        (header->version >= 2 && ((header->meshlet_offset % 4) != 0 || header->meshlet_offset > size ||
+                                  (size - header->meshlet_offset) / sizeof(struct rasterizer_meshlet) < header->meshlet_count)))
+    {
+        mesh_unload(mesh);
+        return -1;
+    }
+
+    mesh->verts = (const rasterizer_packed_vertex *)((const char *)base + header->vertex_offset);
+    mesh->indices = (const unsigned int *)((const char *)base + header->index_offset);
+    mesh->nverts = header->vertex_count;
+    mesh->nindices = header->index_count;
+    memcpy(mesh->scale, header->scale, sizeof(mesh->scale));
+    memcpy(mesh->bias, header->bias, sizeof(mesh->bias));
+    if (header->version >= 2 && header->meshlet_count > 0)
+    {
+        // meshlet ranges index the index array directly, so unlike the vertices they cannot be trusted
+        const struct rasterizer_meshlet *meshlets = (const struct rasterizer_meshlet *)((const char *)base + header->meshlet_offset);
+        for (unsigned int i = 0; i < header->meshlet_count; i++)
+        {
+            if ((unsigned long long)meshlets[i].first_index + (unsigned long long)meshlets[i].triangle_count * 3 > header->index_count)
+            {
+                mesh_unload(mesh);
+                return -1;
+            }
+        }
+
+        mesh->meshlets = meshlets;
+        mesh->nmeshlets = header->meshlet_count;
+        return 0;
+    }
+
+    // the builder uses the indices to address its own arrays
+    for (unsigned int i = 0; i < mesh->nindices; i++)
+    {
+        if (mesh->indices[i] >= mesh->nverts)
+        {
+            mesh_unload(mesh);
+            return -1;
+        }
+    }
+
+    // older files are clustered now, without meshlets the mesh is still drawn, just without the culling
+    float *positions = (float *)malloc(sizeof(float) * 3 * (mesh->nverts > 0 ? mesh->nverts : 1));
+    if (positions != NULL)
+    {
+        for (unsigned int v = 0; v < mesh->nverts; v++)
+        {
+            positions[v * 3 + 0] = (float)mesh->verts[v].x * mesh->scale[0] + mesh->bias[0];
+            positions[v * 3 + 1] = (float)mesh->verts[v].y * mesh->scale[1] + mesh->bias[1];
+            positions[v * 3 + 2] = (float)mesh->verts[v].z * mesh->scale[2] + mesh->bias[2];
+        }
+
+        mesh->built_meshlets = mesh_build_meshlets(positions, mesh->nverts, mesh->indices, mesh->nindices, &mesh->nmeshlets);
+        mesh->meshlets = mesh->built_meshlets;
+        free(positions);
+    }
+
+    return 0;
+}
+
+void mesh_unload(struct mesh *mesh)
+{
+    if (mesh->map_base != NULL)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(mesh->map_base);
+#else
+        munmap(mesh->map_base, mesh->map_size);
+#endif
+    }
+
+    free(mesh->built_meshlets);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+void mesh_get_bounds(const struct mesh *mesh, struct rasterizer_bounds *bounds)
+{
+    bounds->type = RASTERIZER_BOUNDS_BOX;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bounds->center[axis] = mesh->bias[axis];
+        bounds->extents[axis] = mesh->scale[axis] * 32767.0f;
+    }
+
+    bounds->radius = 0.0f;
+}
+
+void mesh_draw(struct rasterizer_state *rs, const struct mesh *mesh)
+{
+    if (mesh->nmeshlets > 0)
+    {
+        rasterizer_draw_packed_meshlets(rs, mesh->verts, mesh->scale, mesh->bias, mesh->indices, mesh->meshlets, mesh->nmeshlets);
+        return;
+    }
+
+    rasterizer_draw_packed_indexed_triangle_list(rs, mesh->verts, mesh->scale, mesh->bias, mesh->indices, mesh->nindices);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "rasterizer.h"
+#include <stdlib.h>
+
+// binary mesh file, little-endian. header, then vertices, then 32-bit triangle list indices, then meshlets.
+// everything is 4-byte aligned so the arrays can be used straight out of a memory mapping. version 1 files end
+// their header before meshlet_count and have no meshlets.
+#define MESH_FILE_MAGIC (0x534D5254)    // 'TRMS'
+#define MESH_FILE_VERSION (2)
+
+struct mesh_file_header
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int vertex_count;
+    unsigned int index_count;
+    unsigned int vertex_offset;
+    unsigned int index_offset;
+    float scale[3];
+    float bias[3];
+    unsigned int meshlet_count;
+    unsigned int meshlet_offset;
+};
+
+struct mesh
+{
+    const rasterizer_packed_vertex *verts;
+    const unsigned int *indices;
+    unsigned int nverts;
+    unsigned int nindices;
+    float scale[3];
+    float bias[3];
+
+    // from the file, or built when it is loaded for files without them (and then owned by the mesh)
+    const struct rasterizer_meshlet *meshlets;
+    unsigned int nmeshlets;
+    struct rasterizer_meshlet *built_meshlets;
+
+    // mapping of the file backing the arrays above
+    void *map_base;
+    size_t map_size;
+};
+
+// parses a wavefront obj (positions, optional vertex colours, polygonal faces) and writes a quantized,
+// vertex-cache-optimized binary mesh. returns 0 on success, -1 on failure.
+int mesh_convert_obj(const char *obj_filename, const char *mesh_filename);
+
+// maps a binary mesh without copying or parsing it. returns 0 on success, -1 on failure.
+int mesh_load(struct mesh *mesh, const char *filename);
+void mesh_unload(struct mesh *mesh);
+
+// partitions a triangle list into meshlets of up to RASTERIZER_MESHLET_MAX_VERTICES vertices and
+// RASTERIZER_MESHLET_MAX_TRIANGLES triangles, each a contiguous range of the indices, with its bounding sphere and
+// normal cone. positions are x, y, z per vertex. returns the meshlets (free them), or NULL if memory ran out.
+struct rasterizer_meshlet *mesh_build_meshlets(const float *positions, size_t nverts, const unsigned int *indices, size_t nindices, unsigned int *out_count);
+
+// object-space box covering the whole quantization range
+void mesh_get_bounds(const struct mesh *mesh, struct rasterizer_bounds *bounds);
+
+// draws meshlet by meshlet, so whole clusters can be culled before their vertices are transformed
+void mesh_draw(struct rasterizer_state *rs, const struct mesh *mesh);
+
+// reorders triangles for a small lru post-transform cache (tom forsyth's linear-speed algorithm). returns 0 on success,
+// -1 if memory could not be allocated, in which case the order is left as it was.
+int mesh_optimize_vertex_cache(unsigned int *indices, size_t nindices, size_t nverts);
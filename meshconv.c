@@ -0,0 +1,40 @@
+#include "mesh.h"
+#include "stream.h"
+#include <stdio.h>
+
+// triangles per chunk of a stream file, a few hundred kilobytes of vertices and indices
+#define MESHCONV_CHUNK_TRIANGLES (16384)
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "usage: %s <input.obj> <output.mesh> [output.stream]\n", argv[0]);
+        return 1;
+    }
+
+    if (mesh_convert_obj(argv[1], argv[2]) != 0)
+    {
+        fprintf(stderr, "failed to convert %s\n", argv[1]);
+        return 1;
+    }
+
+    if (argc == 4)
+    {
+        struct mesh mesh;
+        int result = mesh_load(&mesh, argv[2]);
+        if (result == 0)
+        {
+            result = stream_write_mesh(&mesh, argv[3], MESHCONV_CHUNK_TRIANGLES);
+            mesh_unload(&mesh);
+        }
+
+        if (result != 0)
+        {
+            fprintf(stderr, "failed to write %s\n", argv[3]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
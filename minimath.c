@@ -1,8 +1,26 @@
 #include "minimath.h"
+#include "fixed.h"
 #include <math.h>
 #include <string.h>
 #define Y_PI (3.14159265358979323846f)
 
+// the fixed point build takes its trigonometry from a table, so matrices come out the same on every platform
+#if RASTERIZER_FIXED_POINT
+static void minimath_sin_cos(float degrees, float *s, float *c)
+{
+    fixed angle = fixed_from_float(degrees);
+    *s = fixed_to_float(fixed_sin(angle));
+    *c = fixed_to_float(fixed_cos(angle));
+}
+#else
+static void minimath_sin_cos(float degrees, float *s, float *c)
+{
+    float rads = degrees * (Y_PI / 180.0f);
+    *s = sinf(rads);
+    *c = cosf(rads);
+}
+#endif
+
 vec4 *vec4_zero(vec4 *dst)
 {
     dst->x = dst->y = dst->z = dst->w = 0.0f;
@@ -116,9 +134,8 @@ vec4 *mat4x4_mul_vec4(vec4 *dst, const mat4x4 *lhs, const vec4 *rhs)
 
 mat4x4 *mat4x4_rotate_x(mat4x4 *dst, float angle)
 {
-    float rads = angle * (Y_PI / 180.0f);
-    float s = sinf(rads);
-    float c = cosf(rads);
+    float s, c;
+    minimath_sin_cos(angle, &s, &c);
 
     vec4_set(&dst->rows[0], 1.0f, 0.0f, 0.0f, 0.0f);
     vec4_set(&dst->rows[1], 0.0f, c, -s, 0.0f);
@@ -129,9 +146,8 @@ mat4x4 *mat4x4_rotate_x(mat4x4 *dst, float angle)
 
 mat4x4 *mat4x4_rotate_y(mat4x4 *dst, float angle)
 {
-    float rads = angle * (Y_PI / 180.0f);
-    float s = sinf(rads);
-    float c = cosf(rads);
+    float s, c;
+    minimath_sin_cos(angle, &s, &c);
 
     vec4_set(&dst->rows[0], c, 0.0f, s, 0.0f);
     vec4_set(&dst->rows[1], 0.0f, 1.0f, 0.0f, 0.0f);
@@ -149,6 +165,15 @@ mat4x4 *mat4x4_translate(mat4x4 *dst, float x, float y, float z)
     return dst;
 }
 
+mat4x4 *mat4x4_scale(mat4x4 *dst, float x, float y, float z)
+{
+    vec4_set(&dst->rows[0], x, 0.0f, 0.0f, 0.0f);
+    vec4_set(&dst->rows[1], 0.0f, y, 0.0f, 0.0f);
+    vec4_set(&dst->rows[2], 0.0f, 0.0f, z, 0.0f);
+    vec4_set(&dst->rows[3], 0.0f, 0.0f, 0.0f, 1.0f);
+    return dst;
+}
+
 mat4x4 *mat4x4_ortho(mat4x4 *dst, float width, float height, float znear, float zfar)
 {
     float hw = width / 2.0f;
@@ -167,10 +192,8 @@ mat4x4 *mat4x4_ortho(mat4x4 *dst, float width, float height, float znear, float
 
 mat4x4 *mat4x4_perspective(mat4x4 *dst, float fov, float aspect, float znear, float zfar)
 {
-    float fov_rads = fov * (Y_PI / 180.0f);
-    float half_fov = fov_rads / 2.0f;
-    float sin_half_fov = sinf(fov_rads);
-    float cos_half_fov = cosf(fov_rads);
+    float sin_half_fov, cos_half_fov;
+    minimath_sin_cos(fov, &sin_half_fov, &cos_half_fov);
 
     float y_scale = cos_half_fov / sin_half_fov;
     float x_scale = y_scale / aspect;
@@ -42,5 +42,6 @@ vec4 *mat4x4_mul_vec4(vec4 *dst, const mat4x4 *lhs, const vec4 *rhs);
 mat4x4 *mat4x4_rotate_x(mat4x4 *dst, float angle);
 mat4x4 *mat4x4_rotate_y(mat4x4 *dst, float angle);
 mat4x4 *mat4x4_translate(mat4x4 *dst, float x, float y, float z); 
+mat4x4 *mat4x4_scale(mat4x4 *dst, float x, float y, float z);
 mat4x4 *mat4x4_ortho(mat4x4 *dst, float width, float height, float znear, float zfar);
 mat4x4 *mat4x4_perspective(mat4x4 *dst, float fov, float aspect, float znear, float zfar);
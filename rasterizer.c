@@ -1,16 +1,25 @@
 #include "rasterizer.h"
-#include "settings.h"
+#include "job_pool.h"
+#include "simd.h"
 #include <math.h>
 #include <string.h>
 
-// we have our own min/max
-#ifdef min
-    #undef min
-#endif
-#ifdef max
-    #undef max
-#endif
+#if RASTERIZER_FIXED_POINT
+static unsigned int rasterizer_lerp_color(unsigned int color1, unsigned int color2, fixed factor)
+{
+    unsigned int result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        unsigned int c1 = (color1 >> shift) & 0xFF;
+        unsigned int c2 = (color2 >> shift) & 0xFF;
+        unsigned int channel = c1 + c2 - (unsigned int)(((long long)c1 * factor) >> FIXED_SHIFT);
+        result |= ((channel > 255) ? 255 : channel) << shift;
+    }
+
+    return result;
+}
 
+#else
 static unsigned int rasterizer_lerp_color(unsigned int color1, unsigned int color2, float factor)
 {
     float c1f[4] = { (float)(color1 & 0xFF) / 255.0f, (float)((color1 >> 8) & 0xFF) / 255.0f, (float)((color1 >> 16) & 0xFF) / 255.0f, (float)((color1 >> 24) & 0xFF) / 255.0f };
@@ -24,7 +33,23 @@ static unsigned int rasterizer_lerp_color(unsigned int color1, unsigned int colo
 
     return MAKE_COLOR_R8G8B8A8_UNORM((unsigned int)(cof[0] * 255.0f), (unsigned int)(cof[1] * 255.0f), (unsigned int)(cof[2] * 255.0f), (unsigned int)(cof[3] * 255.0f));
 }
+#endif
+
+#if RASTERIZER_FIXED_POINT
+// factors in 16.16, summing to one
+static unsigned int rasterizer_interpolate_color(unsigned int color1, unsigned int color2, unsigned int color3, fixed factor1, fixed factor2, fixed factor3)
+{
+    unsigned int result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        long long c = (long long)((color1 >> shift) & 0xFF) * factor1 + (long long)((color2 >> shift) & 0xFF) * factor2 + (long long)((color3 >> shift) & 0xFF) * factor3;
+        unsigned int channel = (unsigned int)(c >> FIXED_SHIFT);
+        result |= ((channel > 255) ? 255 : channel) << shift;
+    }
 
+    return result;
+}
+#else
 static unsigned int rasterizer_interpolate_color(unsigned int color1, unsigned int color2, unsigned int color3, float factor1, float factor2, float factor3)
 {
     float c1f[4] = { (float)(color1 & 0xFF) / 255.0f, (float)((color1 >> 8) & 0xFF) / 255.0f, (float)((color1 >> 16) & 0xFF) / 255.0f, (float)((color1 >> 24) & 0xFF) / 255.0f };
@@ -40,188 +65,2558 @@ static unsigned int rasterizer_interpolate_color(unsigned int color1, unsigned i
 
     return MAKE_COLOR_R8G8B8A8_UNORM((unsigned int)(cof[0] * 255.0f), (unsigned int)(cof[1] * 255.0f), (unsigned int)(cof[2] * 255.0f), (unsigned int)(cof[3] * 255.0f));
 }
+#endif
 
-static void rasterizer_xform_vertex(const struct rasterizer_state *rs, const rasterizer_vertex *in_vertex, rasterizer_vertex *out_vertex)
+void rasterizer_init(struct rasterizer_state *rs, const struct rasterizer_functions *functions)
 {
-    vec4 temp;
-    vec4_set(&temp, in_vertex->x, in_vertex->y, in_vertex->z, 1.0f);
+    memset(rs, 0, sizeof(*rs));
+    memcpy(&rs->functions, functions, sizeof(rs->functions));
+    mat4x4_identity(&rs->world_matrix);
+    mat4x4_identity(&rs->view_matrix);
+    mat4x4_identity(&rs->projection_matrix);
+    rs->nviewports = 1;
+    rs->viewport_mask = ~0u;
+    rs->flags = RASTERIZER_FLAG_COLOR_INTERPOLATION;
+    rs->dirty = RASTERIZER_DIRTY_ALL;
+}
 
-    // to projection space
-    mat4x4_mul_vec4(&temp, &rs->projection_matrix, mat4x4_mul_vec4(&temp, &rs->view_matrix, mat4x4_mul_vec4(&temp, &rs->world_matrix, &temp)));
-    temp.x /= temp.w;
-    temp.y /= temp.w;
-    temp.z /= temp.w;
+void rasterizer_destroy(struct rasterizer_state *rs)
+{
+    free(rs->scratch);
+    rs->scratch = NULL;
+    rs->scratch_size = 0;
+}
 
-    // to viewport space
-    float x = (float)rs->viewport.top_left_x + (1.0f + temp.x) * (float)rs->viewport.width / 2.0f;
-    float y = (float)rs->viewport.top_left_y + (1.0f - temp.y) * (float)rs->viewport.height / 2.0f;
-    float z = 0.0f + temp.z * (1.0f - 0.0f);
-    out_vertex->x = x;
-    out_vertex->y = y;
-    out_vertex->z = z;
-    out_vertex->color = in_vertex->color;
+void rasterizer_set_flags(struct rasterizer_state *rs, unsigned int flags)
+{
+    rs->flags = flags;
 }
 
-void rasterizer_draw_screen_line(const struct rasterizer_state *rs, float x1, float y1, unsigned int color1, float x2, float y2, unsigned int color2)
+// returns at least size bytes owned by the context, valid until the next call, or NULL if memory ran out
+static void *rasterizer_get_scratch(struct rasterizer_state *rs, size_t size)
 {
-    // http://en.wikipedia.org/wiki/Bresenham%27s_line_algorithm
+    if (size > rs->scratch_size)
+    {
+        free(rs->scratch);
+        rs->scratch = malloc(size);
+        rs->scratch_size = (rs->scratch != NULL) ? size : 0;
+    }
 
-    float xdiff = x2 - x1;
-    float ydiff = y2 - y1;
-    if (fabsf(xdiff) > fabsf(ydiff))
+    return rs->scratch;
+}
+
+void rasterizer_set_world_matrix(struct rasterizer_state *rs, const mat4x4 *world_matrix)
+{
+    memcpy(&rs->world_matrix, world_matrix, sizeof(rs->world_matrix));
+    rs->dirty |= RASTERIZER_DIRTY_WORLD;
+}
+
+void rasterizer_set_view_matrix(struct rasterizer_state *rs, const mat4x4 *view_matrix)
+{
+    memcpy(&rs->view_matrix, view_matrix, sizeof(rs->view_matrix));
+    rs->dirty |= RASTERIZER_DIRTY_VIEW;
+}
+
+void rasterizer_set_projection_matrix(struct rasterizer_state *rs, const mat4x4 *projection_matrix)
+{
+    memcpy(&rs->projection_matrix, projection_matrix, sizeof(rs->projection_matrix));
+    rs->dirty |= RASTERIZER_DIRTY_PROJECTION;
+}
+
+void rasterizer_set_viewport(struct rasterizer_state *rs, const struct viewport_state *viewport)
+{
+    rasterizer_set_viewports(rs, viewport, 1);
+}
+
+void rasterizer_set_viewports(struct rasterizer_state *rs, const struct viewport_state *viewports, unsigned int count)
+{
+    count = (count < RASTERIZER_MAX_VIEWPORTS) ? count : RASTERIZER_MAX_VIEWPORTS;
+    memcpy(rs->viewports, viewports, sizeof(struct viewport_state) * count);
+    rs->nviewports = count;
+    rs->current_viewport = 0;
+    if (count > 0)
+        rs->viewport = viewports[0];
+
+    rs->dirty |= RASTERIZER_DIRTY_VIEWPORT;
+}
+
+void rasterizer_set_viewport_mask(struct rasterizer_state *rs, unsigned int mask)
+{
+    rs->viewport_mask = mask;
+}
+
+void rasterizer_set_scissor(struct rasterizer_state *rs, const struct rasterizer_rect *scissor)
+{
+    rs->has_scissor = (scissor != NULL);
+    if (scissor != NULL)
+        rs->scissor = *scissor;
+
+    rs->dirty |= RASTERIZER_DIRTY_SCISSOR;
+}
+
+void rasterizer_set_bounds(struct rasterizer_state *rs, const struct rasterizer_bounds *bounds)
+{
+    rs->has_bounds = (bounds != NULL);
+    if (bounds != NULL)
+        rs->bounds = *bounds;
+
+    rs->dirty |= RASTERIZER_DIRTY_BOUNDS;
+}
+
+void rasterizer_set_job_pool(struct rasterizer_state *rs, struct job_pool *pool)
+{
+    rs->job_pool = pool;
+}
+
+void rasterizer_span_buffer_init(struct rasterizer_span_buffer *sb, struct rasterizer_span *spans, size_t capacity, rs_spans_fn flush, void *userdata)
+{
+    memset(sb, 0, sizeof(*sb));
+    sb->spans = spans;
+    sb->capacity = capacity;
+    sb->flush = flush;
+    sb->userdata = userdata;
+}
+
+void rasterizer_span_buffer_flush(struct rasterizer_span_buffer *sb)
+{
+    if (sb->flush != NULL && sb->count > 0)
+        sb->flush(sb->userdata, sb->spans, sb->count);
+
+    sb->count = 0;
+    sb->dropped = 0;
+}
+
+void rasterizer_set_span_buffer(struct rasterizer_state *rs, struct rasterizer_span_buffer *sb)
+{
+    rs->span_buffer = sb;
+}
+
+static void rasterizer_emit_span(struct rasterizer_span_buffer *sb, const struct rasterizer_span *span)
+{
+    if (sb->count == sb->capacity)
     {
-        float xmin;
-        float xmax;
-        if (x1 < x2)
+        if (sb->flush == NULL || sb->capacity == 0)
         {
-            xmin = x1;
-            xmax = x2;
+            sb->dropped++;
+            return;
         }
-        else
+
+        sb->flush(sb->userdata, sb->spans, sb->count);
+        sb->count = 0;
+    }
+
+    sb->spans[sb->count++] = *span;
+}
+
+int rasterizer_bounds_in_frustum(const struct rasterizer_bounds *bounds, const vec4 planes[RASTERIZER_FRUSTUM_PLANE_COUNT])
+{
+    const float *c = bounds->center;
+    const float *e = bounds->extents;
+    for (int i = 0; i < RASTERIZER_FRUSTUM_PLANE_COUNT; i++)
+    {
+        // a box reaches as far towards the plane as its extents projected onto the normal
+        const vec4 *plane = &planes[i];
+        float distance = plane->x * c[0] + plane->y * c[1] + plane->z * c[2] + plane->w;
+        float radius = bounds->radius;
+        if (bounds->type == RASTERIZER_BOUNDS_BOX)
+            radius = fabsf(plane->x) * e[0] + fabsf(plane->y) * e[1] + fabsf(plane->z) * e[2];
+
+        if (distance < -radius)
+            return 0;
+    }
+
+    return 1;
+}
+
+int rasterizer_depth_buffer_init(struct rasterizer_depth_buffer *db, int width, int height)
+{
+    memset(db, 0, sizeof(*db));
+    db->width = width;
+    db->height = height;
+    db->tiles_x = (width + RASTERIZER_DEPTH_TILE_SIZE - 1) / RASTERIZER_DEPTH_TILE_SIZE;
+    db->tiles_y = (height + RASTERIZER_DEPTH_TILE_SIZE - 1) / RASTERIZER_DEPTH_TILE_SIZE;
+    db->depth = (rasterizer_depth *)malloc(sizeof(rasterizer_depth) * (size_t)width * (size_t)height);
+    db->tile_max = (rasterizer_depth *)malloc(sizeof(rasterizer_depth) * (size_t)db->tiles_x * (size_t)db->tiles_y);
+
+    // every level in one allocation, level 0 matches the tiles
+    size_t hiz_size = 0;
+    int level_width = db->tiles_x;
+    int level_height = db->tiles_y;
+    for (;;)
+    {
+        db->hiz_width[db->hiz_levels] = level_width;
+        db->hiz_height[db->hiz_levels] = level_height;
+        hiz_size += (size_t)level_width * (size_t)level_height;
+        db->hiz_levels++;
+        if ((level_width <= 1 && level_height <= 1) || db->hiz_levels == RASTERIZER_HIZ_MAX_LEVELS)
+            break;
+
+        level_width = (level_width + 1) / 2;
+        level_height = (level_height + 1) / 2;
+    }
+
+    db->hiz[0] = (rasterizer_depth *)malloc(sizeof(rasterizer_depth) * hiz_size);
+    if (db->depth == NULL || db->tile_max == NULL || db->hiz[0] == NULL)
+    {
+        rasterizer_depth_buffer_destroy(db);
+        return -1;
+    }
+
+    for (int level = 1; level < db->hiz_levels; level++)
+        db->hiz[level] = db->hiz[level - 1] + db->hiz_width[level - 1] * db->hiz_height[level - 1];
+
+    rasterizer_depth_buffer_clear(db);
+    return 0;
+}
+
+void rasterizer_depth_buffer_destroy(struct rasterizer_depth_buffer *db)
+{
+    free(db->depth);
+    free(db->tile_max);
+    free(db->hiz[0]);
+    memset(db, 0, sizeof(*db));
+}
+
+void rasterizer_depth_buffer_clear(struct rasterizer_depth_buffer *db)
+{
+    size_t count = (size_t)db->width * (size_t)db->height;
+    for (size_t i = 0; i < count; i++)
+        db->depth[i] = RASTERIZER_DEPTH_ONE;
+
+    count = (size_t)db->tiles_x * (size_t)db->tiles_y;
+    for (size_t i = 0; i < count; i++)
+        db->tile_max[i] = RASTERIZER_DEPTH_ONE;
+
+    db->hiz_valid = 0;
+}
+
+void rasterizer_set_depth_buffer(struct rasterizer_state *rs, struct rasterizer_depth_buffer *db)
+{
+    rs->depth_buffer = db;
+}
+
+void rasterizer_build_hiz(struct rasterizer_state *rs)
+{
+    struct rasterizer_depth_buffer *db = rs->depth_buffer;
+    if (db == NULL)
+        return;
+
+    // exact per-tile maxima, which also tightens the conservative tile bounds kept during rasterization
+    for (int ty = 0; ty < db->tiles_y; ty++)
+    {
+        int y0 = ty * RASTERIZER_DEPTH_TILE_SIZE;
+        int y1 = (y0 + RASTERIZER_DEPTH_TILE_SIZE < db->height) ? (y0 + RASTERIZER_DEPTH_TILE_SIZE) : db->height;
+        for (int tx = 0; tx < db->tiles_x; tx++)
         {
-            xmin = x2;
-            xmax = x1;
+            int x0 = tx * RASTERIZER_DEPTH_TILE_SIZE;
+            int x1 = (x0 + RASTERIZER_DEPTH_TILE_SIZE < db->width) ? (x0 + RASTERIZER_DEPTH_TILE_SIZE) : db->width;
+            rasterizer_depth tile_max = 0;
+            for (int y = y0; y < y1; y++)
+            {
+                const rasterizer_depth *row = db->depth + y * db->width;
+                for (int x = x0; x < x1; x++)
+                    tile_max = (row[x] > tile_max) ? row[x] : tile_max;
+            }
+
+            db->tile_max[ty * db->tiles_x + tx] = tile_max;
+            db->hiz[0][ty * db->tiles_x + tx] = tile_max;
         }
+    }
 
-        float slope = ydiff / xdiff;
-        for (float x = xmin; x <= xmax; x += 1.0f)
+    // each texel of the next level covers 2x2 of the previous, clamped at odd edges
+    for (int level = 1; level < db->hiz_levels; level++)
+    {
+        const rasterizer_depth *src = db->hiz[level - 1];
+        int src_width = db->hiz_width[level - 1];
+        int src_height = db->hiz_height[level - 1];
+        rasterizer_depth *dst = db->hiz[level];
+        for (int y = 0; y < db->hiz_height[level]; y++)
         {
-            float y = y1 + (x - x1) * slope;
-#if defined(COLOR_INTERPOLATION)
-            unsigned int color = rasterizer_lerp_color(color1, color2, ((x - x1) / xdiff));
-#else
-            unsigned int color = MAKE_COLOR_R8G8B8_UNORM(255, 255, 255);
-#endif
-            rs->functions.set_pixel(rs->functions.userdata, (int)x, (int)y, color);
+            int sy0 = y * 2;
+            int sy1 = (sy0 + 1 < src_height) ? (sy0 + 1) : sy0;
+            for (int x = 0; x < db->hiz_width[level]; x++)
+            {
+                int sx0 = x * 2;
+                int sx1 = (sx0 + 1 < src_width) ? (sx0 + 1) : sx0;
+                rasterizer_depth a = src[sy0 * src_width + sx0];
+                rasterizer_depth b = src[sy0 * src_width + sx1];
+                rasterizer_depth c = src[sy1 * src_width + sx0];
+                rasterizer_depth d = src[sy1 * src_width + sx1];
+                rasterizer_depth ab = (a > b) ? a : b;
+                rasterizer_depth cd = (c > d) ? c : d;
+                dst[y * db->hiz_width[level] + x] = (ab > cd) ? ab : cd;
+            }
         }
     }
-    else
+
+    db->hiz_valid = 1;
+}
+
+static void rasterizer_extract_planes(vec4 planes[RASTERIZER_FRUSTUM_PLANE_COUNT], const mat4x4 *m)
+{
+    // gribb/hartmann, with clip space z in [0, w] rather than [-w, w]
+    const vec4 *r = m->rows;
+    vec4_add(&planes[RASTERIZER_FRUSTUM_LEFT], &r[3], &r[0]);
+    vec4_sub(&planes[RASTERIZER_FRUSTUM_RIGHT], &r[3], &r[0]);
+    vec4_add(&planes[RASTERIZER_FRUSTUM_BOTTOM], &r[3], &r[1]);
+    vec4_sub(&planes[RASTERIZER_FRUSTUM_TOP], &r[3], &r[1]);
+    vec4_copy(&planes[RASTERIZER_FRUSTUM_NEAR], &r[2]);
+    vec4_sub(&planes[RASTERIZER_FRUSTUM_FAR], &r[3], &r[2]);
+
+    for (int i = 0; i < RASTERIZER_FRUSTUM_PLANE_COUNT; i++)
     {
-        float ymin;
-        float ymax;
-        if (y1 < y2)
+        vec4 *plane = &planes[i];
+        float length = sqrtf(plane->x * plane->x + plane->y * plane->y + plane->z * plane->z);
+        if (length > 0.0f)
         {
-            ymin = y1;
-            ymax = y2;
+            float rcp_length = 1.0f / length;
+            vec4_set(plane, plane->x * rcp_length, plane->y * rcp_length, plane->z * rcp_length, plane->w * rcp_length);
         }
-        else
+    }
+}
+
+// the point (or direction) m maps to clip x = y = w = 0, from the cofactors of m's third row. scaled by the
+// determinant they give the vector along which clip z increases by one and nothing else changes.
+static void rasterizer_extract_eye(vec4 *eye, float *facing, const mat4x4 *m)
+{
+    const float (*d)[4] = m->data;
+    float cofactors[4];
+    for (int col = 0; col < 4; col++)
+    {
+        int c[3], n = 0;
+        for (int i = 0; i < 4; i++)
         {
-            ymin = y2;
-            ymax = y1;
+            if (i != col)
+                c[n++] = i;
         }
 
-        float slope = xdiff / ydiff;
-        for (float y = ymin; y <= ymax; y += 1.0f)
-        {
-            float x = x1 + (y - y1) * slope;
-#if defined(COLOR_INTERPOLATION)
-            unsigned int color = rasterizer_lerp_color(color1, color2, ((y - y1) / ydiff));
-#else
-            unsigned int color = MAKE_COLOR_R8G8B8_UNORM(255, 255, 255);
-#endif
+        float minor = d[0][c[0]] * (d[1][c[1]] * d[3][c[2]] - d[1][c[2]] * d[3][c[1]]) -
+                      d[0][c[1]] * (d[1][c[0]] * d[3][c[2]] - d[1][c[2]] * d[3][c[0]]) +
+                      d[0][c[2]] * (d[1][c[0]] * d[3][c[1]] - d[1][c[1]] * d[3][c[0]]);
+        cofactors[col] = (col & 1) ? -minor : minor;
+    }
 
-            rs->functions.set_pixel(rs->functions.userdata, (int)x, (int)y, color);
-        }
+    float determinant = d[2][0] * cofactors[0] + d[2][1] * cofactors[1] + d[2][2] * cofactors[2] + d[2][3] * cofactors[3];
+    *facing = (determinant < 0.0f) ? -1.0f : 1.0f;
+    if (determinant == 0.0f)
+    {
+        vec4_set(eye, 0.0f, 0.0f, 0.0f, 0.0f);
+        return;
+    }
+
+    float length = sqrtf(cofactors[0] * cofactors[0] + cofactors[1] * cofactors[1] + cofactors[2] * cofactors[2]);
+    if (fabsf(cofactors[3]) > length * 1e-6f)
+    {
+        float rcp_w = 1.0f / cofactors[3];
+        vec4_set(eye, cofactors[0] * rcp_w, cofactors[1] * rcp_w, cofactors[2] * rcp_w, 1.0f);
+    }
+    else
+    {
+        float scale = (determinant < 0.0f) ? (-1.0f / length) : (1.0f / length);
+        vec4_set(eye, cofactors[0] * scale, cofactors[1] * scale, cofactors[2] * scale, 0.0f);
     }
 }
 
-void rasterizer_draw_line(const struct rasterizer_state *rs, const rasterizer_vertex verts[2])
+// the current viewport, intersected with the scissor, as inclusive pixel bounds
+static void rasterizer_get_clip_rect(const struct rasterizer_state *rs, int clip_min[2], int clip_max[2])
 {
-    // transform to world, then view, then projection space
-    rasterizer_vertex start, end;
-    rasterizer_xform_vertex(rs, &verts[0], &start);
-    rasterizer_xform_vertex(rs, &verts[1], &end);
-
-    // really basic culling
-    if (start.z < 0.0f && end.z < 0.0f)
+    clip_min[0] = rs->viewport.top_left_x;
+    clip_min[1] = rs->viewport.top_left_y;
+    clip_max[0] = rs->viewport.top_left_x + rs->viewport.width - 1;
+    clip_max[1] = rs->viewport.top_left_y + rs->viewport.height - 1;
+    if (!rs->has_scissor)
         return;
 
-    // draw it
-    rasterizer_draw_screen_line(rs, start.x, start.y, start.color, end.x, end.y, end.color);
+    clip_min[0] = (rs->scissor.x > clip_min[0]) ? rs->scissor.x : clip_min[0];
+    clip_min[1] = (rs->scissor.y > clip_min[1]) ? rs->scissor.y : clip_min[1];
+    clip_max[0] = (rs->scissor.x + rs->scissor.width - 1 < clip_max[0]) ? (rs->scissor.x + rs->scissor.width - 1) : clip_max[0];
+    clip_max[1] = (rs->scissor.y + rs->scissor.height - 1 < clip_max[1]) ? (rs->scissor.y + rs->scissor.height - 1) : clip_max[1];
 }
 
-void rasterizer_draw_line_list(const struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts)
+const struct rasterizer_derived_state *rasterizer_get_derived_state(struct rasterizer_state *rs)
 {
-    for (size_t start = 0; start < nverts; start += 2)
-        rasterizer_draw_line(rs, verts + start);
+    unsigned int dirty = rs->dirty;
+    struct rasterizer_derived_state *derived = &rs->derived;
+    if (dirty == 0)
+        return derived;
+
+    if (dirty & (RASTERIZER_DIRTY_VIEW | RASTERIZER_DIRTY_PROJECTION))
+    {
+        mat4x4_mul(&derived->view_projection, &rs->projection_matrix, &rs->view_matrix);
+        rasterizer_extract_planes(derived->world_planes, &derived->view_projection);
+    }
+
+    if (dirty & (RASTERIZER_DIRTY_WORLD | RASTERIZER_DIRTY_VIEW | RASTERIZER_DIRTY_PROJECTION))
+    {
+        mat4x4_mul(&derived->world_view_projection, &derived->view_projection, &rs->world_matrix);
+        rasterizer_extract_planes(derived->object_planes, &derived->world_view_projection);
+        rasterizer_extract_eye(&derived->object_eye, &derived->object_facing, &derived->world_view_projection);
+#if RASTERIZER_FIXED_POINT
+        fixed_mat4x4_from_mat4x4(&derived->fixed_world_view_projection, &derived->world_view_projection);
+#endif
+    }
+
+    if (dirty & (RASTERIZER_DIRTY_WORLD | RASTERIZER_DIRTY_VIEW | RASTERIZER_DIRTY_PROJECTION | RASTERIZER_DIRTY_BOUNDS))
+        derived->bounds_visible = !rs->has_bounds || rasterizer_bounds_in_frustum(&rs->bounds, derived->object_planes);
+
+    if (dirty & RASTERIZER_DIRTY_VIEWPORT)
+    {
+        // y flips, ndc is y-up and the viewport y-down
+        derived->viewport_scale[0] = (float)rs->viewport.width / 2.0f;
+        derived->viewport_scale[1] = -(float)rs->viewport.height / 2.0f;
+        derived->viewport_offset[0] = (float)rs->viewport.top_left_x + (float)rs->viewport.width / 2.0f;
+        derived->viewport_offset[1] = (float)rs->viewport.top_left_y + (float)rs->viewport.height / 2.0f;
+#if RASTERIZER_FIXED_POINT
+        derived->fixed_viewport_scale[0] = rs->viewport.width << (FIXED_SHIFT - 1);
+        derived->fixed_viewport_scale[1] = -(rs->viewport.height << (FIXED_SHIFT - 1));
+        derived->fixed_viewport_offset[0] = (rs->viewport.top_left_x * 2 + rs->viewport.width) << (FIXED_SHIFT - 1);
+        derived->fixed_viewport_offset[1] = (rs->viewport.top_left_y * 2 + rs->viewport.height) << (FIXED_SHIFT - 1);
+#endif
+    }
+
+    if (dirty & (RASTERIZER_DIRTY_VIEWPORT | RASTERIZER_DIRTY_SCISSOR))
+        rasterizer_get_clip_rect(rs, derived->clip_min, derived->clip_max);
+
+    rs->dirty = 0;
+    return derived;
 }
 
-void rasterizer_draw_triangle(const struct rasterizer_state *rs, const rasterizer_vertex verts[3])
+// returns non-zero if the bounds, transformed by combined, are certainly behind the hi-z pyramid
+static int rasterizer_bounds_occluded(const struct rasterizer_state *rs, const struct rasterizer_bounds *bounds, const mat4x4 *combined)
 {
-    // transform to world, then view, then projection space
-    rasterizer_vertex projected_vertices[3];
-    for (int i = 0; i < 3; i++)
-        rasterizer_xform_vertex(rs, &verts[i], &projected_vertices[i]);
+    const struct rasterizer_depth_buffer *db = rs->depth_buffer;
+    if (db == NULL || !db->hiz_valid)
+        return 0;
 
-#if 1
-    // https://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/
-#define min(v1, v2) ((v1) < (v2) ? (v1) : (v2))
-#define max(v1, v2) ((v1) > (v2) ? (v1) : (v2))
-#define min3(v1, v2, v3) (((v1) < (v2)) ? (((v1) < (v3)) ? (v1) : (v3)) : (((v2) < (v3)) ? (v2) : (v3)))
-#define max3(v1, v2, v3) (((v1) > (v2)) ? (((v1) > (v3)) ? (v1) : (v3)) : (((v2) > (v3)) ? (v2) : (v3)))
-#define orient2d(ax, ay, bx, by, cx, cy) ((bx - ax) * (cy - ay) - (by - ay) * (cx - ax))
+    // screen rectangle and nearest depth of the box corners, spheres are treated as their enclosing box
+    float extents[3];
+    for (int axis = 0; axis < 3; axis++)
+        extents[axis] = (bounds->type == RASTERIZER_BOUNDS_SPHERE) ? bounds->radius : bounds->extents[axis];
 
-    // round to integers
-    for (int i = 0; i < 3; i++)
+    const struct rasterizer_derived_state *derived = &rs->derived;
+    float min_x = 3.402823466e+38f, min_y = 3.402823466e+38f, min_z = 3.402823466e+38f;
+    float max_x = -3.402823466e+38f, max_y = -3.402823466e+38f;
+    for (int corner = 0; corner < 8; corner++)
     {
-//         projected_vertices[i].x = floorf(projected_vertices[i].x + 0.5f);
-//         projected_vertices[i].y = floorf(projected_vertices[i].y + 0.5f);
-//         projected_vertices[i].z = floorf(projected_vertices[i].z + 0.5f);
-        projected_vertices[i].x = floorf(projected_vertices[i].x);
-        projected_vertices[i].y = floorf(projected_vertices[i].y);
-        projected_vertices[i].z = floorf(projected_vertices[i].z);
+        vec4 temp;
+        vec4_set(&temp,
+                 bounds->center[0] + ((corner & 1) ? extents[0] : -extents[0]),
+                 bounds->center[1] + ((corner & 2) ? extents[1] : -extents[1]),
+                 bounds->center[2] + ((corner & 4) ? extents[2] : -extents[2]),
+                 1.0f);
+        mat4x4_mul_vec4(&temp, combined, &temp);
+
+        // reaches behind the near plane, the projected rectangle means nothing
+        if (temp.w <= 0.0f || temp.z < 0.0f)
+            return 0;
+
+        float rcp_w = 1.0f / temp.w;
+        float x = derived->viewport_offset[0] + temp.x * rcp_w * derived->viewport_scale[0];
+        float y = derived->viewport_offset[1] + temp.y * rcp_w * derived->viewport_scale[1];
+        float z = temp.z * rcp_w;
+        min_x = (x < min_x) ? x : min_x;
+        max_x = (x > max_x) ? x : max_x;
+        min_y = (y < min_y) ? y : min_y;
+        max_y = (y > max_y) ? y : max_y;
+        min_z = (z < min_z) ? z : min_z;
     }
 
-    // calculate triangle bounding box
-    int minX = min3((int)projected_vertices[0].x, (int)projected_vertices[1].x, (int)projected_vertices[2].x);
-    int minY = min3((int)projected_vertices[0].y, (int)projected_vertices[1].y, (int)projected_vertices[2].y);
-    int maxX = max3((int)projected_vertices[0].x, (int)projected_vertices[1].x, (int)projected_vertices[2].x);
-    int maxY = max3((int)projected_vertices[0].y, (int)projected_vertices[1].y, (int)projected_vertices[2].y);
-
-    // clip against screen bounds
-    minX = max(minX, 0);
-    maxX = min(maxX, rs->viewport.width - 1);
-    minY = max(minY, 0);
-    maxY = min(maxY, rs->viewport.height - 1);
-
-    // rasterize
-    for (int y = minY; y <= maxY; y++)
+    // clamp to the buffer, the frustum test deals with anything entirely off screen
+    int x0 = (min_x > 0.0f) ? (int)min_x : 0;
+    int y0 = (min_y > 0.0f) ? (int)min_y : 0;
+    int x1 = (max_x < (float)(db->width - 1)) ? (int)max_x : (db->width - 1);
+    int y1 = (max_y < (float)(db->height - 1)) ? (int)max_y : (db->height - 1);
+    if (x0 > x1 || y0 > y1)
+        return 0;
+
+    // coarsest level at which the rectangle spans no more than 2x2 texels
+    int tx0 = x0 / RASTERIZER_DEPTH_TILE_SIZE, tx1 = x1 / RASTERIZER_DEPTH_TILE_SIZE;
+    int ty0 = y0 / RASTERIZER_DEPTH_TILE_SIZE, ty1 = y1 / RASTERIZER_DEPTH_TILE_SIZE;
+    int level = 0;
+    while ((level + 1) < db->hiz_levels && ((tx1 - tx0) > 1 || (ty1 - ty0) > 1))
     {
-        for (int x = minX; x <= maxX; x++)
-        {
-            int w0 = orient2d((int)projected_vertices[1].x, (int)projected_vertices[1].y, (int)projected_vertices[2].x, (int)projected_vertices[2].y, x, y);
-            int w1 = orient2d((int)projected_vertices[2].x, (int)projected_vertices[2].y, (int)projected_vertices[0].x, (int)projected_vertices[0].y, x, y);
-            int w2 = orient2d((int)projected_vertices[0].x, (int)projected_vertices[0].y, (int)projected_vertices[1].x, (int)projected_vertices[1].y, x, y);
+        tx0 >>= 1;
+        tx1 >>= 1;
+        ty0 >>= 1;
+        ty1 >>= 1;
+        level++;
+    }
 
-            if (w0 >= 0 && w1 >= 0 && w2 >= 0)
-            {
-#if defined(COLOR_INTERPOLATION)
-                // interpolate color
-                int S = w0 + w1 + w2;
-                float factor1 = (float)(w1 / (float)S);
-                float factor2 = (float)(w2 / (float)S);
-                float factor3 = (float)(w0 / (float)S);
-                unsigned int color = rasterizer_interpolate_color(projected_vertices[0].color, projected_vertices[1].color, projected_vertices[2].color, factor1, factor2, factor3);
+#if RASTERIZER_FIXED_POINT
+    // truncation only brings it nearer, which keeps the test conservative
+    rasterizer_depth nearest = fixed_from_float(min_z);
 #else
-                unsigned int color = MAKE_COLOR_R8G8B8_UNORM(255, 255, 255);
+    rasterizer_depth nearest = min_z;
 #endif
 
-                rs->functions.set_pixel(rs->functions.userdata, x, y, color);
-            }
+    const rasterizer_depth *hiz = db->hiz[level];
+    int hiz_width = db->hiz_width[level];
+    for (int ty = ty0; ty <= ty1; ty++)
+    {
+        for (int tx = tx0; tx <= tx1; tx++)
+        {
+            if (nearest < hiz[ty * hiz_width + tx])
+                return 0;
         }
     }
 
-#undef min
-#undef min3
-#undef max3
-#undef orient2d
+    return 1;
+}
+
+// the viewports a draw renders into
+static unsigned int rasterizer_get_viewport_mask(const struct rasterizer_state *rs)
+{
+    return rs->viewport_mask & ((1u << rs->nviewports) - 1);
+}
+
+// makes the lowest viewport left in *remaining current and removes it, returns zero once none are left
+static int rasterizer_next_viewport(struct rasterizer_state *rs, unsigned int *remaining)
+{
+    if (*remaining == 0)
+        return 0;
+
+    unsigned int index = 0;
+    while (!(*remaining & (1u << index)))
+        index++;
+
+    *remaining &= ~(1u << index);
+    if (index != rs->current_viewport)
+    {
+        rs->viewport = rs->viewports[index];
+        rs->current_viewport = index;
+        rs->dirty |= RASTERIZER_DIRTY_VIEWPORT;
+    }
+
+    return 1;
+}
+
+// brings the derived state up to date, returns zero if the draw's bounds are outside the frustum or occluded
+static int rasterizer_begin_draw(struct rasterizer_state *rs)
+{
+    if (rs->visibility_buffer != NULL)
+        rs->visibility_buffer->new_draw = 1;
+
+    const struct rasterizer_derived_state *derived = rasterizer_get_derived_state(rs);
+    if (!derived->bounds_visible)
+        return 0;
+
+    return !rs->has_bounds || !rasterizer_bounds_occluded(rs, &rs->bounds, &derived->world_view_projection);
+}
+
+int rasterizer_occlusion_query(struct rasterizer_state *rs, const struct rasterizer_bounds *bounds)
+{
+    const struct rasterizer_derived_state *derived = rasterizer_get_derived_state(rs);
+    return rasterizer_bounds_in_frustum(bounds, derived->object_planes) &&
+           !rasterizer_bounds_occluded(rs, bounds, &derived->world_view_projection);
+}
+
+#if RASTERIZER_FIXED_POINT
+// keeps vertices far outside the viewport (or close to w = 0) from overflowing the edge functions, about 16k pixels
+#define RASTERIZER_FIXED_COORD_LIMIT ((long long)1 << 30)
 
+static fixed rasterizer_fixed_clamp(long long value)
+{
+    return (fixed)((value < -RASTERIZER_FIXED_COORD_LIMIT) ? -RASTERIZER_FIXED_COORD_LIMIT : ((value > RASTERIZER_FIXED_COORD_LIMIT) ? RASTERIZER_FIXED_COORD_LIMIT : value));
+}
+
+// integer equivalent of rasterizer_xform_vertex, to viewport space x, y and depth in 16.16
+static void rasterizer_xform_fixed(const struct rasterizer_derived_state *derived, const fixed_mat4x4 *combined, const fixed_vec4 *position, fixed out[3])
+{
+    long long clip[4];
+    fixed_mat4x4_mul_point(clip, combined, position);
+
+    // back to 16.16 for the divide, w is kept away from zero
+    long long x = clip[0] >> FIXED_SHIFT;
+    long long y = clip[1] >> FIXED_SHIFT;
+    long long z = clip[2] >> FIXED_SHIFT;
+    long long w = clip[3] >> FIXED_SHIFT;
+    if (w == 0)
+        w = 1;
+
+    out[0] = derived->fixed_viewport_offset[0] + rasterizer_fixed_clamp((x * derived->fixed_viewport_scale[0]) / w);
+    out[1] = derived->fixed_viewport_offset[1] + rasterizer_fixed_clamp((y * derived->fixed_viewport_scale[1]) / w);
+    out[2] = rasterizer_fixed_clamp((z << FIXED_SHIFT) / w);
+}
+
+static void rasterizer_load_fixed_position(fixed_vec4 *dst, const rasterizer_vertex *vertex)
+{
+    dst->x = fixed_from_float(vertex->x);
+    dst->y = fixed_from_float(vertex->y);
+    dst->z = fixed_from_float(vertex->z);
+    dst->w = FIXED_ONE;
+}
+#else
+// the derived state must be current, which every public draw entry point ensures before getting here
+static void rasterizer_xform_vertex(const struct rasterizer_state *rs, const rasterizer_vertex *in_vertex, rasterizer_vertex *out_vertex)
+{
+    const struct rasterizer_derived_state *derived = &rs->derived;
+    vec4 temp;
+    vec4_set(&temp, in_vertex->x, in_vertex->y, in_vertex->z, 1.0f);
+
+    // to projection space
+    mat4x4_mul_vec4(&temp, &derived->world_view_projection, &temp);
+    float rcp_w = 1.0f / temp.w;
+
+    // to viewport space
+    out_vertex->x = derived->viewport_offset[0] + temp.x * rcp_w * derived->viewport_scale[0];
+    out_vertex->y = derived->viewport_offset[1] + temp.y * rcp_w * derived->viewport_scale[1];
+    out_vertex->z = temp.z * rcp_w;
+    out_vertex->color = in_vertex->color;
+}
 #endif
+
+// lines are drawn a pixel at a time, in span mode consecutive pixels on a row are gathered into run first
+static void rasterizer_end_line_run(const struct rasterizer_state *rs, struct rasterizer_span *run)
+{
+    if (run->x_end > run->x_start)
+        rasterizer_emit_span(rs->span_buffer, run);
+
+    run->x_end = run->x_start;
 }
 
-void rasterizer_draw_triangle_list(const struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts)
+static void rasterizer_line_pixel(const struct rasterizer_state *rs, struct rasterizer_span *run, int x, int y, unsigned int color)
 {
-    for (size_t start = 0; start < nverts; start += 3)
-        rasterizer_draw_triangle(rs, verts + start);
+    if (rs->span_buffer == NULL)
+    {
+        rs->functions.set_pixel(rs->functions.userdata, x, y, color);
+        return;
+    }
+
+    if (run->x_end > run->x_start && y == run->y && x == run->x_end)
+    {
+        run->x_end++;
+        run->color_end = color;
+        return;
+    }
+
+    rasterizer_end_line_run(rs, run);
+    run->y = y;
+    run->x_start = x;
+    run->x_end = x + 1;
+    run->color_start = run->color_end = color;
 }
 
+#if RASTERIZER_FIXED_POINT
+// same stepping as the float version below, one pixel at a time along the longer axis
+static void rasterizer_draw_fixed_screen_line(const struct rasterizer_state *rs, fixed x1, fixed y1, unsigned int color1, fixed x2, fixed y2, unsigned int color2)
+{
+    int clip_min[2], clip_max[2];
+    rasterizer_get_clip_rect(rs, clip_min, clip_max);
+
+    long long xdiff = (long long)x2 - x1;
+    long long ydiff = (long long)y2 - y1;
+    int x_major = (llabs(xdiff) > llabs(ydiff));
+    fixed major1 = x_major ? x1 : y1;
+    fixed major2 = x_major ? x2 : y2;
+    fixed minor1 = x_major ? y1 : x1;
+    long long major_diff = x_major ? xdiff : ydiff;
+    long long minor_diff = x_major ? ydiff : xdiff;
+    fixed major_min = (major1 < major2) ? major1 : major2;
+    fixed major_max = (major1 < major2) ? major2 : major1;
+    struct rasterizer_span run;
+    memset(&run, 0, sizeof(run));
+    for (fixed major = major_min; major <= major_max; major += FIXED_ONE)
+    {
+        // a single point has no direction, it is drawn where it is
+        long long step = (long long)major - major1;
+        fixed minor = (major_diff != 0) ? (minor1 + (fixed)((step * minor_diff) / major_diff)) : minor1;
+        int x = FIXED_FLOOR(x_major ? major : minor);
+        int y = FIXED_FLOOR(x_major ? minor : major);
+        if (x < clip_min[0] || x > clip_max[0] || y < clip_min[1] || y > clip_max[1])
+            continue;
+
+        fixed factor = (major_diff != 0) ? (fixed)((step << FIXED_SHIFT) / major_diff) : 0;
+        unsigned int color = (rs->flags & RASTERIZER_FLAG_COLOR_INTERPOLATION) ? rasterizer_lerp_color(color1, color2, factor) : MAKE_COLOR_R8G8B8_UNORM(255, 255, 255);
+        rasterizer_line_pixel(rs, &run, x, y, color);
+    }
+
+    rasterizer_end_line_run(rs, &run);
+}
+
+void rasterizer_draw_screen_line(const struct rasterizer_state *rs, float x1, float y1, unsigned int color1, float x2, float y2, unsigned int color2)
+{
+    rasterizer_draw_fixed_screen_line(rs, rasterizer_fixed_clamp(fixed_from_float(x1)), rasterizer_fixed_clamp(fixed_from_float(y1)), color1,
+                                      rasterizer_fixed_clamp(fixed_from_float(x2)), rasterizer_fixed_clamp(fixed_from_float(y2)), color2);
+}
+
+// start and end are viewport x, y and depth from rasterizer_xform_fixed
+static void rasterizer_draw_fixed_line(const struct rasterizer_state *rs, const fixed start[3], unsigned int start_color, const fixed end[3], unsigned int end_color)
+{
+    // really basic culling
+    if (start[2] < 0 && end[2] < 0)
+        return;
+
+    rasterizer_draw_fixed_screen_line(rs, start[0], start[1], start_color, end[0], end[1], end_color);
+}
+#else
+void rasterizer_draw_screen_line(const struct rasterizer_state *rs, float x1, float y1, unsigned int color1, float x2, float y2, unsigned int color2)
+{
+    // http://en.wikipedia.org/wiki/Bresenham%27s_line_algorithm
+    int clip_min[2], clip_max[2];
+    rasterizer_get_clip_rect(rs, clip_min, clip_max);
+
+    struct rasterizer_span run;
+    memset(&run, 0, sizeof(run));
+    float xdiff = x2 - x1;
+    float ydiff = y2 - y1;
+    if (fabsf(xdiff) > fabsf(ydiff))
+    {
+        float xmin;
+        float xmax;
+        if (x1 < x2)
+        {
+            xmin = x1;
+            xmax = x2;
+        }
+        else
+        {
+            xmin = x2;
+            xmax = x1;
+        }
+
+        float slope = ydiff / xdiff;
+        for (float x = xmin; x <= xmax; x += 1.0f)
+        {
+            float y = y1 + (x - x1) * slope;
+            if ((int)x < clip_min[0] || (int)x > clip_max[0] || (int)y < clip_min[1] || (int)y > clip_max[1])
+                continue;
+
+            unsigned int color = (rs->flags & RASTERIZER_FLAG_COLOR_INTERPOLATION) ? rasterizer_lerp_color(color1, color2, ((x - x1) / xdiff)) : MAKE_COLOR_R8G8B8_UNORM(255, 255, 255);
+            rasterizer_line_pixel(rs, &run, (int)x, (int)y, color);
+        }
+    }
+    else
+    {
+        float ymin;
+        float ymax;
+        if (y1 < y2)
+        {
+            ymin = y1;
+            ymax = y2;
+        }
+        else
+        {
+            ymin = y2;
+            ymax = y1;
+        }
+
+        float slope = xdiff / ydiff;
+        for (float y = ymin; y <= ymax; y += 1.0f)
+        {
+            float x = x1 + (y - y1) * slope;
+            if ((int)x < clip_min[0] || (int)x > clip_max[0] || (int)y < clip_min[1] || (int)y > clip_max[1])
+                continue;
+
+            unsigned int color = (rs->flags & RASTERIZER_FLAG_COLOR_INTERPOLATION) ? rasterizer_lerp_color(color1, color2, ((y - y1) / ydiff)) : MAKE_COLOR_R8G8B8_UNORM(255, 255, 255);
+
+            rasterizer_line_pixel(rs, &run, (int)x, (int)y, color);
+        }
+    }
+
+    rasterizer_end_line_run(rs, &run);
+}
+
+static void rasterizer_draw_projected_line(const struct rasterizer_state *rs, const rasterizer_vertex *start, const rasterizer_vertex *end)
+{
+    // really basic culling
+    if (start->z < 0.0f && end->z < 0.0f)
+        return;
+
+    // draw it
+    rasterizer_draw_screen_line(rs, start->x, start->y, start->color, end->x, end->y, end->color);
+}
+#endif
+
+void rasterizer_draw_line(struct rasterizer_state *rs, const rasterizer_vertex verts[2])
+{
+    // transform to viewport space with the cached world/view/projection matrix
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+#if RASTERIZER_FIXED_POINT
+        fixed_vec4 position;
+        fixed start[3], end[3];
+        rasterizer_load_fixed_position(&position, &verts[0]);
+        rasterizer_xform_fixed(&rs->derived, &rs->derived.fixed_world_view_projection, &position, start);
+        rasterizer_load_fixed_position(&position, &verts[1]);
+        rasterizer_xform_fixed(&rs->derived, &rs->derived.fixed_world_view_projection, &position, end);
+        rasterizer_draw_fixed_line(rs, start, verts[0].color, end, verts[1].color);
+#else
+        rasterizer_vertex start, end;
+        rasterizer_xform_vertex(rs, &verts[0], &start);
+        rasterizer_xform_vertex(rs, &verts[1], &end);
+        rasterizer_draw_projected_line(rs, &start, &end);
+#endif
+    }
+}
+
+void rasterizer_draw_line_list(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts)
+{
+    for (size_t start = 0; start < nverts; start += 2)
+        rasterizer_draw_line(rs, verts + start);
+}
+
+// a vertex after transformation, snapped to the pixel grid
+struct rasterizer_screen_vertex
+{
+    int x;
+    int y;
+    rasterizer_depth z;
+    unsigned int color;
+};
+
+// edge function, w(x, y) = a * x + b * y + c, non-negative on the inside of the edge
+struct rasterizer_edge
+{
+    int a;
+    int b;
+    int c;
+};
+
+enum rasterizer_topology
+{
+    RASTERIZER_TOPOLOGY_TRIANGLE_LIST,
+    RASTERIZER_TOPOLOGY_TRIANGLE_STRIP,
+    RASTERIZER_TOPOLOGY_TRIANGLE_FAN,
+};
+
+// where primitive assembly reads vertices from, either plain, packed + dequantization, or already transformed
+struct rasterizer_vertex_source
+{
+    const rasterizer_vertex *verts;
+    const rasterizer_packed_vertex *packed_verts;
+    const float *scale;
+    const float *bias;
+    const struct rasterizer_screen_vertex *screen_verts;
+
+#if RASTERIZER_FIXED_POINT
+    // scale and bias converted once per draw
+    fixed fixed_scale[3];
+    fixed fixed_bias[3];
+#endif
+};
+
+// direct-mapped post-transform cache, so shared vertices of indexed draws are only transformed once
+#define RASTERIZER_VERTEX_CACHE_SIZE (32)
+struct rasterizer_vertex_cache
+{
+    unsigned int tags[RASTERIZER_VERTEX_CACHE_SIZE];
+    struct rasterizer_screen_vertex entries[RASTERIZER_VERTEX_CACHE_SIZE];
+};
+
+#if RASTERIZER_FIXED_POINT
+// rasterizer_xform_fixed, snapped to the pixel grid
+static void rasterizer_project_fixed(const struct rasterizer_derived_state *derived, const fixed_mat4x4 *combined, const fixed_vec4 *position, unsigned int color, struct rasterizer_screen_vertex *out_vertex)
+{
+    fixed projected[3];
+    rasterizer_xform_fixed(derived, combined, position, projected);
+    out_vertex->x = FIXED_FLOOR(projected[0]);
+    out_vertex->y = FIXED_FLOOR(projected[1]);
+    out_vertex->z = projected[2];
+    out_vertex->color = color;
+}
+
+static void rasterizer_snap_vertex(const struct rasterizer_state *rs, const rasterizer_vertex *in_vertex, struct rasterizer_screen_vertex *out_vertex)
+{
+    fixed_vec4 position;
+    rasterizer_load_fixed_position(&position, in_vertex);
+    rasterizer_project_fixed(&rs->derived, &rs->derived.fixed_world_view_projection, &position, in_vertex->color, out_vertex);
+}
+#else
+static void rasterizer_snap_projected_vertex(const rasterizer_vertex *projected, struct rasterizer_screen_vertex *out_vertex)
+{
+    // round to integers
+    out_vertex->x = (int)floorf(projected->x);
+    out_vertex->y = (int)floorf(projected->y);
+    out_vertex->z = projected->z;
+    out_vertex->color = projected->color;
+}
+
+static void rasterizer_snap_vertex(const struct rasterizer_state *rs, const rasterizer_vertex *in_vertex, struct rasterizer_screen_vertex *out_vertex)
+{
+    rasterizer_vertex projected;
+    rasterizer_xform_vertex(rs, in_vertex, &projected);
+    rasterizer_snap_projected_vertex(&projected, out_vertex);
+}
+#endif
+
+static void rasterizer_fetch_vertex(const struct rasterizer_state *rs, const struct rasterizer_vertex_source *source, unsigned int index, struct rasterizer_screen_vertex *out_vertex)
+{
+    if (source->screen_verts != NULL)
+    {
+        *out_vertex = source->screen_verts[index];
+        return;
+    }
+
+    if (source->packed_verts == NULL)
+    {
+        rasterizer_snap_vertex(rs, &source->verts[index], out_vertex);
+        return;
+    }
+
+    const rasterizer_packed_vertex *packed = &source->packed_verts[index];
+#if RASTERIZER_FIXED_POINT
+    fixed_vec4 position =
+    {
+        (fixed)((long long)packed->x * source->fixed_scale[0] + source->fixed_bias[0]),
+        (fixed)((long long)packed->y * source->fixed_scale[1] + source->fixed_bias[1]),
+        (fixed)((long long)packed->z * source->fixed_scale[2] + source->fixed_bias[2]),
+        FIXED_ONE,
+    };
+    rasterizer_project_fixed(&rs->derived, &rs->derived.fixed_world_view_projection, &position, packed->color, out_vertex);
+#else
+    rasterizer_vertex vertex;
+    vertex.x = (float)packed->x * source->scale[0] + source->bias[0];
+    vertex.y = (float)packed->y * source->scale[1] + source->bias[1];
+    vertex.z = (float)packed->z * source->scale[2] + source->bias[2];
+    vertex.color = packed->color;
+    rasterizer_snap_vertex(rs, &vertex, out_vertex);
+#endif
+}
+
+static void rasterizer_setup_edge(struct rasterizer_edge *edge, const struct rasterizer_screen_vertex *from, const struct rasterizer_screen_vertex *to)
+{
+    // same as orient2d(from, to, p), expanded so it can be stepped incrementally
+    edge->a = from->y - to->y;
+    edge->b = to->x - from->x;
+    edge->c = from->x * to->y - from->y * to->x;
+}
+
+static void rasterizer_flip_edge(struct rasterizer_edge *dst, const struct rasterizer_edge *src)
+{
+    // the same edge walked the other way, as seen by the neighbouring triangle
+    dst->a = -src->a;
+    dst->b = -src->b;
+    dst->c = -src->c;
+}
+
+// colour of a covered pixel, from the edge function values there
+static unsigned int rasterizer_shade_pixel(const struct rasterizer_state *rs, const struct rasterizer_screen_vertex *v0, const struct rasterizer_screen_vertex *v1, const struct rasterizer_screen_vertex *v2, int w0, int w1, int w2)
+{
+    if (!(rs->flags & RASTERIZER_FLAG_COLOR_INTERPOLATION))
+        return MAKE_COLOR_R8G8B8_UNORM(255, 255, 255);
+
+    // interpolate color
+    int S = w0 + w1 + w2;
+#if RASTERIZER_FIXED_POINT
+    fixed factor1 = (fixed)(((long long)w1 << FIXED_SHIFT) / S);
+    fixed factor2 = (fixed)(((long long)w2 << FIXED_SHIFT) / S);
+    fixed factor3 = (fixed)(((long long)w0 << FIXED_SHIFT) / S);
+#else
+    float factor1 = (float)(w1 / (float)S);
+    float factor2 = (float)(w2 / (float)S);
+    float factor3 = (float)(w0 / (float)S);
+#endif
+    return rasterizer_interpolate_color(v0->color, v1->color, v2->color, factor1, factor2, factor3);
+}
+
+// what the resolve needs to shade a pixel of the triangle again
+struct rasterizer_visibility_triangle
+{
+    struct rasterizer_screen_vertex verts[3];
+    struct rasterizer_edge edges[3];
+};
+
+#define RASTERIZER_VISIBILITY_TRIANGLE_MASK ((1u << RASTERIZER_VISIBILITY_TRIANGLE_BITS) - 1)
+
+// the all-ones id is RASTERIZER_VISIBILITY_EMPTY, so neither field may reach its maximum
+#define RASTERIZER_VISIBILITY_MAX_DRAWS ((1u << (32 - RASTERIZER_VISIBILITY_TRIANGLE_BITS)) - 1)
+#define RASTERIZER_VISIBILITY_MAX_DRAW_TRIANGLES (RASTERIZER_VISIBILITY_TRIANGLE_MASK)
+
+int rasterizer_visibility_buffer_init(struct rasterizer_visibility_buffer *vb, int width, int height)
+{
+    memset(vb, 0, sizeof(*vb));
+    vb->width = width;
+    vb->height = height;
+    vb->ids = (unsigned int *)malloc(sizeof(unsigned int) * (size_t)width * (size_t)height);
+    if (vb->ids == NULL)
+        return -1;
+
+    memset(vb->ids, 0xFF, sizeof(unsigned int) * (size_t)width * (size_t)height);
+    vb->new_draw = 1;
+    return 0;
+}
+
+void rasterizer_visibility_buffer_destroy(struct rasterizer_visibility_buffer *vb)
+{
+    free(vb->ids);
+    free(vb->triangles);
+    free(vb->draw_first_triangle);
+    memset(vb, 0, sizeof(*vb));
+}
+
+void rasterizer_set_visibility_buffer(struct rasterizer_state *rs, struct rasterizer_visibility_buffer *vb)
+{
+    rs->visibility_buffer = vb;
+}
+
+static void rasterizer_visibility_flush(const struct rasterizer_state *rs, struct rasterizer_visibility_buffer *vb)
+{
+    // a tile at a time, so the ids, and the triangles they reference, stay in cache while being shaded
+    for (int tileY = 0; tileY < vb->height; tileY += RASTERIZER_DEPTH_TILE_SIZE)
+    {
+        int y1 = (tileY + RASTERIZER_DEPTH_TILE_SIZE < vb->height) ? (tileY + RASTERIZER_DEPTH_TILE_SIZE) : vb->height;
+        for (int tileX = 0; tileX < vb->width; tileX += RASTERIZER_DEPTH_TILE_SIZE)
+        {
+            int x1 = (tileX + RASTERIZER_DEPTH_TILE_SIZE < vb->width) ? (tileX + RASTERIZER_DEPTH_TILE_SIZE) : vb->width;
+            for (int y = tileY; y < y1; y++)
+            {
+                unsigned int *row = vb->ids + y * vb->width;
+                for (int x = tileX; x < x1; x++)
+                {
+                    unsigned int id = row[x];
+                    if (id == RASTERIZER_VISIBILITY_EMPTY)
+                        continue;
+
+                    row[x] = RASTERIZER_VISIBILITY_EMPTY;
+                    const struct rasterizer_visibility_triangle *triangle =
+                        &vb->triangles[vb->draw_first_triangle[id >> RASTERIZER_VISIBILITY_TRIANGLE_BITS] + (id & RASTERIZER_VISIBILITY_TRIANGLE_MASK)];
+
+                    const struct rasterizer_edge *edges = triangle->edges;
+                    int w0 = edges[0].a * x + edges[0].b * y + edges[0].c;
+                    int w1 = edges[1].a * x + edges[1].b * y + edges[1].c;
+                    int w2 = edges[2].a * x + edges[2].b * y + edges[2].c;
+                    unsigned int color = rasterizer_shade_pixel(rs, &triangle->verts[0], &triangle->verts[1], &triangle->verts[2], w0, w1, w2);
+                    rs->functions.set_pixel(rs->functions.userdata, x, y, color);
+                }
+            }
+        }
+    }
+
+    vb->ntriangles = 0;
+    vb->ndraws = 0;
+    vb->new_draw = 1;
+}
+
+void rasterizer_resolve_visibility(struct rasterizer_state *rs)
+{
+    if (rs->visibility_buffer != NULL)
+        rasterizer_visibility_flush(rs, rs->visibility_buffer);
+}
+
+// records the triangle and returns the id its pixels are tagged with, or RASTERIZER_VISIBILITY_EMPTY if memory ran out
+// and the triangle has to be dropped
+static unsigned int rasterizer_visibility_add_triangle(const struct rasterizer_state *rs, struct rasterizer_visibility_buffer *vb, const struct rasterizer_screen_vertex *v0, const struct rasterizer_screen_vertex *v1, const struct rasterizer_screen_vertex *v2, const struct rasterizer_edge edges[3])
+{
+    // a draw with more triangles than fit in the id simply continues under the next draw id
+    if (vb->new_draw || (vb->ntriangles - vb->draw_first_triangle[vb->ndraws - 1]) == RASTERIZER_VISIBILITY_MAX_DRAW_TRIANGLES)
+    {
+        // out of ids, shade what is there now. later draws overwrite it where they are in front, so the result is the same.
+        if (vb->ndraws == RASTERIZER_VISIBILITY_MAX_DRAWS)
+            rasterizer_visibility_flush(rs, vb);
+
+        if (vb->ndraws == vb->draws_capacity)
+        {
+            unsigned int capacity = (vb->draws_capacity == 0) ? 64 : (vb->draws_capacity * 2);
+            unsigned int *draw_first_triangle = (unsigned int *)realloc(vb->draw_first_triangle, sizeof(unsigned int) * capacity);
+            if (draw_first_triangle == NULL)
+                return RASTERIZER_VISIBILITY_EMPTY;
+
+            vb->draw_first_triangle = draw_first_triangle;
+            vb->draws_capacity = capacity;
+        }
+
+        vb->draw_first_triangle[vb->ndraws++] = vb->ntriangles;
+        vb->new_draw = 0;
+    }
+
+    if (vb->ntriangles == vb->triangles_capacity)
+    {
+        unsigned int capacity = (vb->triangles_capacity == 0) ? 1024 : (vb->triangles_capacity * 2);
+        struct rasterizer_visibility_triangle *triangles = (struct rasterizer_visibility_triangle *)realloc(vb->triangles, sizeof(struct rasterizer_visibility_triangle) * capacity);
+        if (triangles == NULL)
+            return RASTERIZER_VISIBILITY_EMPTY;
+
+        vb->triangles = triangles;
+        vb->triangles_capacity = capacity;
+    }
+
+    struct rasterizer_visibility_triangle *triangle = &vb->triangles[vb->ntriangles];
+    triangle->verts[0] = *v0;
+    triangle->verts[1] = *v1;
+    triangle->verts[2] = *v2;
+    memcpy(triangle->edges, edges, sizeof(triangle->edges));
+
+    unsigned int draw = vb->ndraws - 1;
+    return (draw << RASTERIZER_VISIBILITY_TRIANGLE_BITS) | (vb->ntriangles++ - vb->draw_first_triangle[draw]);
+}
+
+// depth as a plane over the screen, z(x, y) = zx * x + zy * y + zc. the fixed point build keeps RASTERIZER_DEPTH_PLANE_BITS
+// more fraction bits than the stored depth, so stepping across the screen does not accumulate the rounding.
+#if RASTERIZER_FIXED_POINT
+#define RASTERIZER_DEPTH_PLANE_BITS (8)
+
+struct rasterizer_depth_plane
+{
+    long long zx, zy, zc;
+};
+#else
+struct rasterizer_depth_plane
+{
+    float zx, zy, zc;
+};
+#endif
+
+// from the vertex depths and the edges, area is the sum of the edge functions over the triangle
+static void rasterizer_setup_depth_plane(struct rasterizer_depth_plane *plane, const struct rasterizer_screen_vertex *v0, const struct rasterizer_screen_vertex *v1, const struct rasterizer_screen_vertex *v2, const struct rasterizer_edge edges[3], int area)
+{
+#if RASTERIZER_FIXED_POINT
+    plane->zx = (((long long)edges[0].a * v0->z + (long long)edges[1].a * v1->z + (long long)edges[2].a * v2->z) << RASTERIZER_DEPTH_PLANE_BITS) / area;
+    plane->zy = (((long long)edges[0].b * v0->z + (long long)edges[1].b * v1->z + (long long)edges[2].b * v2->z) << RASTERIZER_DEPTH_PLANE_BITS) / area;
+    plane->zc = (((long long)edges[0].c * v0->z + (long long)edges[1].c * v1->z + (long long)edges[2].c * v2->z) << RASTERIZER_DEPTH_PLANE_BITS) / area;
+#else
+    float rcp_area = 1.0f / (float)area;
+    plane->zx = ((float)edges[0].a * v0->z + (float)edges[1].a * v1->z + (float)edges[2].a * v2->z) * rcp_area;
+    plane->zy = ((float)edges[0].b * v0->z + (float)edges[1].b * v1->z + (float)edges[2].b * v2->z) * rcp_area;
+    plane->zc = ((float)edges[0].c * v0->z + (float)edges[1].c * v1->z + (float)edges[2].c * v2->z) * rcp_area;
+#endif
+}
+
+static rasterizer_depth rasterizer_depth_at(const struct rasterizer_depth_plane *plane, int x, int y)
+{
+#if RASTERIZER_FIXED_POINT
+    return (rasterizer_depth)((plane->zx * x + plane->zy * y + plane->zc) >> RASTERIZER_DEPTH_PLANE_BITS);
+#else
+    return plane->zx * (float)x + plane->zy * (float)y + plane->zc;
+#endif
+}
+
+// depth at an offset, in 1/16 pixels, from where center was evaluated
+static rasterizer_depth rasterizer_depth_at_offset(const struct rasterizer_depth_plane *plane, rasterizer_depth center, int dx, int dy)
+{
+#if RASTERIZER_FIXED_POINT
+    return center + (rasterizer_depth)((plane->zx * dx + plane->zy * dy) >> (RASTERIZER_DEPTH_PLANE_BITS + 4));
+#else
+    return center + (plane->zx * (float)dx + plane->zy * (float)dy) * (1.0f / 16.0f);
+#endif
+}
+
+// sample positions in 1/16 pixel steps from the pixel centre, rotated grids so near-horizontal and near-vertical edges
+// both get as many distinct coverage levels as there are samples
+static const signed char rasterizer_msaa_offsets_2x[2][2] = { { 4, 4 }, { -4, -4 } };
+static const signed char rasterizer_msaa_offsets_4x[4][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+
+int rasterizer_msaa_buffer_init(struct rasterizer_msaa_buffer *mb, int width, int height, int samples)
+{
+    memset(mb, 0, sizeof(*mb));
+    if (samples != 2 && samples != 4)
+        return -1;
+
+    size_t count = (size_t)width * (size_t)height;
+    mb->width = width;
+    mb->height = height;
+    mb->samples = samples;
+    mb->colors = (unsigned int *)malloc(sizeof(unsigned int) * count);
+    mb->depths = (rasterizer_depth *)malloc(sizeof(rasterizer_depth) * count);
+    mb->edge_index = (unsigned int *)malloc(sizeof(unsigned int) * count);
+    if (mb->colors == NULL || mb->depths == NULL || mb->edge_index == NULL)
+    {
+        rasterizer_msaa_buffer_destroy(mb);
+        return -1;
+    }
+
+    rasterizer_msaa_buffer_clear(mb);
+    return 0;
+}
+
+void rasterizer_msaa_buffer_destroy(struct rasterizer_msaa_buffer *mb)
+{
+    free(mb->colors);
+    free(mb->depths);
+    free(mb->edge_index);
+    free(mb->edge_colors);
+    free(mb->edge_depths);
+    memset(mb, 0, sizeof(*mb));
+}
+
+void rasterizer_msaa_buffer_clear(struct rasterizer_msaa_buffer *mb)
+{
+    // colours and depths of empty pixels are never read, so only the indices need resetting
+    memset(mb->edge_index, 0xFF, sizeof(unsigned int) * (size_t)mb->width * (size_t)mb->height);
+    mb->nedge_samples = 0;
+}
+
+void rasterizer_set_msaa_buffer(struct rasterizer_state *rs, struct rasterizer_msaa_buffer *mb)
+{
+    rs->msaa_buffer = mb;
+}
+
+// moves a pixel into the edge arrays, one sample per slot, copying what it held before. returns RASTERIZER_MSAA_EMPTY,
+// leaving the pixel as it was, if memory ran out.
+static unsigned int rasterizer_msaa_expand_pixel(struct rasterizer_msaa_buffer *mb, size_t pixel)
+{
+    if ((mb->nedge_samples + (unsigned int)mb->samples) > mb->edge_capacity)
+    {
+        // either array may have grown when the other fails, the capacity only counts once both have
+        unsigned int capacity = (mb->edge_capacity == 0) ? 4096 : (mb->edge_capacity * 2);
+        unsigned int *edge_colors = (unsigned int *)realloc(mb->edge_colors, sizeof(unsigned int) * capacity);
+        if (edge_colors == NULL)
+            return RASTERIZER_MSAA_EMPTY;
+
+        mb->edge_colors = edge_colors;
+        rasterizer_depth *edge_depths = (rasterizer_depth *)realloc(mb->edge_depths, sizeof(rasterizer_depth) * capacity);
+        if (edge_depths == NULL)
+            return RASTERIZER_MSAA_EMPTY;
+
+        mb->edge_depths = edge_depths;
+        mb->edge_capacity = capacity;
+    }
+
+    unsigned int index = mb->nedge_samples;
+    int uniform = (mb->edge_index[pixel] == RASTERIZER_MSAA_UNIFORM);
+    for (int s = 0; s < mb->samples; s++)
+    {
+        mb->edge_colors[index + s] = uniform ? mb->colors[pixel] : 0;
+        mb->edge_depths[index + s] = uniform ? mb->depths[pixel] : RASTERIZER_DEPTH_ONE;
+    }
+
+    mb->nedge_samples += (unsigned int)mb->samples;
+    mb->edge_index[pixel] = index;
+    return index;
+}
+
+// coverage and depth per sample, colour once per pixel
+static void rasterizer_msaa_shade_pixel(const struct rasterizer_state *rs, struct rasterizer_msaa_buffer *mb, const struct rasterizer_screen_vertex *v0, const struct rasterizer_screen_vertex *v1, const struct rasterizer_screen_vertex *v2, const struct rasterizer_edge edges[3],
+                                        int x, int y, int w0, int w1, int w2, int depth_test, const struct rasterizer_depth_plane *plane)
+{
+    const signed char (*offsets)[2] = (mb->samples == 4) ? rasterizer_msaa_offsets_4x : rasterizer_msaa_offsets_2x;
+    unsigned int all = (1u << mb->samples) - 1;
+    unsigned int covered = 0;
+    for (int s = 0; s < mb->samples; s++)
+    {
+        int dx = offsets[s][0];
+        int dy = offsets[s][1];
+        if ((w0 * 16 + edges[0].a * dx + edges[0].b * dy) >= 0 &&
+            (w1 * 16 + edges[1].a * dx + edges[1].b * dy) >= 0 &&
+            (w2 * 16 + edges[2].a * dx + edges[2].b * dy) >= 0)
+        {
+            covered |= 1u << s;
+        }
+    }
+
+    if (covered == 0)
+        return;
+
+    size_t pixel = (size_t)y * (size_t)mb->width + (size_t)x;
+    unsigned int index = mb->edge_index[pixel];
+    rasterizer_depth center_z = rasterizer_depth_at(plane, x, y);
+    rasterizer_depth sample_z[4];
+    unsigned int passed = covered;
+    if (depth_test)
+    {
+        // uniform pixels only kept the depth at their centre, which stands in for all of their samples
+        passed = 0;
+        for (int s = 0; s < mb->samples; s++)
+        {
+            if (!(covered & (1u << s)))
+                continue;
+
+            rasterizer_depth stored = RASTERIZER_DEPTH_ONE;
+            if (index == RASTERIZER_MSAA_UNIFORM)
+                stored = mb->depths[pixel];
+            else if (index != RASTERIZER_MSAA_EMPTY)
+                stored = mb->edge_depths[index + s];
+
+            sample_z[s] = rasterizer_depth_at_offset(plane, center_z, offsets[s][0], offsets[s][1]);
+            if (sample_z[s] >= 0 && sample_z[s] < stored)
+                passed |= 1u << s;
+        }
+
+        if (passed == 0)
+            return;
+    }
+
+    // the centre may lie outside the triangle, clamping keeps the weights (which always sum to at least the area) inside it
+    unsigned int color = rasterizer_shade_pixel(rs, v0, v1, v2, (w0 > 0) ? w0 : 0, (w1 > 0) ? w1 : 0, (w2 > 0) ? w2 : 0);
+
+    // everything covered collapses the pixel back to a single value, leaving its old edge samples unused until the clear
+    if (passed == all)
+    {
+        mb->edge_index[pixel] = RASTERIZER_MSAA_UNIFORM;
+        mb->colors[pixel] = color;
+        mb->depths[pixel] = center_z;
+        return;
+    }
+
+    if (index == RASTERIZER_MSAA_EMPTY || index == RASTERIZER_MSAA_UNIFORM)
+    {
+        index = rasterizer_msaa_expand_pixel(mb, pixel);
+        if (index == RASTERIZER_MSAA_EMPTY)
+            return;
+    }
+
+    for (int s = 0; s < mb->samples; s++)
+    {
+        if (!(passed & (1u << s)))
+            continue;
+
+        mb->edge_colors[index + s] = color;
+        if (depth_test)
+            mb->edge_depths[index + s] = sample_z[s];
+    }
+}
+
+// box filter over a pixel's samples, per channel
+static unsigned int rasterizer_msaa_average(const unsigned int *colors, int samples)
+{
+#if defined(USE_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i sum;
+    if (samples == 4)
+    {
+        // bytes to words, then fold the four samples down into the low 64 bits
+        __m128i packed = _mm_loadu_si128((const __m128i *)colors);
+        sum = _mm_add_epi16(_mm_unpacklo_epi8(packed, zero), _mm_unpackhi_epi8(packed, zero));
+        sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+    }
+    else
+    {
+        __m128i packed = _mm_loadl_epi64((const __m128i *)colors);
+        sum = _mm_unpacklo_epi8(packed, zero);
+        sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(1)), 1);
+    }
+
+    return (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(sum, zero));
+#else
+    int shift = (samples == 4) ? 2 : 1;
+    unsigned int result = 0;
+    for (int channel = 0; channel < 32; channel += 8)
+    {
+        unsigned int sum = 0;
+        for (int s = 0; s < samples; s++)
+            sum += (colors[s] >> channel) & 0xFF;
+
+        result |= ((sum + (1u << (shift - 1))) >> shift) << channel;
+    }
+
+    return result;
+#endif
+}
+
+void rasterizer_resolve_msaa(struct rasterizer_state *rs)
+{
+    struct rasterizer_msaa_buffer *mb = rs->msaa_buffer;
+    if (mb == NULL)
+        return;
+
+    for (int y = 0; y < mb->height; y++)
+    {
+        const unsigned int *row = mb->edge_index + (size_t)y * (size_t)mb->width;
+        for (int x = 0; x < mb->width; x++)
+        {
+            unsigned int index = row[x];
+            if (index == RASTERIZER_MSAA_EMPTY)
+                continue;
+
+            unsigned int color;
+            if (index == RASTERIZER_MSAA_UNIFORM)
+                color = mb->colors[(size_t)y * (size_t)mb->width + x];
+            else
+                color = rasterizer_msaa_average(mb->edge_colors + index, mb->samples);
+
+            rs->functions.set_pixel(rs->functions.userdata, x, y, color);
+        }
+    }
+}
+
+int rasterizer_oit_buffer_init(struct rasterizer_oit_buffer *ob, int width, int height)
+{
+    memset(ob, 0, sizeof(*ob));
+    size_t count = (size_t)width * (size_t)height;
+    ob->width = width;
+    ob->height = height;
+    ob->accum = (unsigned int *)malloc(sizeof(unsigned int) * 4 * count);
+    ob->revealage = (unsigned short *)malloc(sizeof(unsigned short) * count);
+    if (ob->accum == NULL || ob->revealage == NULL)
+    {
+        rasterizer_oit_buffer_destroy(ob);
+        return -1;
+    }
+
+    rasterizer_oit_buffer_clear(ob);
+    return 0;
+}
+
+void rasterizer_oit_buffer_destroy(struct rasterizer_oit_buffer *ob)
+{
+    free(ob->accum);
+    free(ob->revealage);
+    memset(ob, 0, sizeof(*ob));
+}
+
+void rasterizer_oit_buffer_clear(struct rasterizer_oit_buffer *ob)
+{
+    size_t count = (size_t)ob->width * (size_t)ob->height;
+    memset(ob->accum, 0, sizeof(unsigned int) * 4 * count);
+    for (size_t i = 0; i < count; i++)
+        ob->revealage[i] = RASTERIZER_OIT_CLEAR;
+}
+
+void rasterizer_set_oit_buffer(struct rasterizer_state *rs, struct rasterizer_oit_buffer *ob)
+{
+    rs->oit_buffer = ob;
+}
+
+// 1 at the far plane up to 64 at the near plane, so where many layers overlap the nearest ones dominate
+static unsigned int rasterizer_oit_weight(rasterizer_depth z)
+{
+#if RASTERIZER_FIXED_POINT
+    int nearness = (int)((RASTERIZER_DEPTH_ONE - z) >> (FIXED_SHIFT - 8));
+#else
+    int nearness = (int)((RASTERIZER_DEPTH_ONE - z) * 256.0f);
+#endif
+    nearness = (nearness < 0) ? 0 : ((nearness > 256) ? 256 : nearness);
+    return 1 + (unsigned int)((nearness * nearness * nearness * 63) >> 24);
+}
+
+// integer sums in both builds, a fragment adds at most 255 * 255 * 64 to a colour channel
+static void rasterizer_oit_accumulate(struct rasterizer_oit_buffer *ob, int x, int y, unsigned int color, rasterizer_depth z)
+{
+    unsigned int alpha = color >> 24;
+    if (alpha == 0)
+        return;
+
+    size_t pixel = (size_t)y * (size_t)ob->width + (size_t)x;
+    unsigned int *accum = ob->accum + pixel * 4;
+    unsigned int weight = rasterizer_oit_weight(z) * alpha;
+
+    // colour sums are at most 255 times the weight sum, halving all four keeps their ratios when they would overflow
+    if (accum[3] > (0xFFFFFFFFu / 255) - weight)
+    {
+        for (int i = 0; i < 4; i++)
+            accum[i] >>= 1;
+    }
+
+    accum[0] += (color & 0xFF) * weight;
+    accum[1] += ((color >> 8) & 0xFF) * weight;
+    accum[2] += ((color >> 16) & 0xFF) * weight;
+    accum[3] += weight;
+    ob->revealage[pixel] = (unsigned short)(((unsigned int)ob->revealage[pixel] * (255 - alpha)) / 255);
+}
+
+void rasterizer_resolve_oit(struct rasterizer_state *rs)
+{
+    struct rasterizer_oit_buffer *ob = rs->oit_buffer;
+    if (ob == NULL)
+        return;
+
+    for (int y = 0; y < ob->height; y++)
+    {
+        for (int x = 0; x < ob->width; x++)
+        {
+            size_t pixel = (size_t)y * (size_t)ob->width + (size_t)x;
+            unsigned int revealage = ob->revealage[pixel];
+            if (revealage == RASTERIZER_OIT_CLEAR)
+                continue;
+
+            // weighted average of the fragments, over the background by the coverage they add up to
+            const unsigned int *accum = ob->accum + pixel * 4;
+            unsigned int background = (rs->functions.get_pixel != NULL) ? rs->functions.get_pixel(rs->functions.userdata, x, y) : 0;
+            unsigned int color = 0xFF000000;
+            for (int i = 0; i < 3; i++)
+            {
+                unsigned int average = accum[i] / accum[3];
+                unsigned int behind = (background >> (i * 8)) & 0xFF;
+                color |= ((average * (RASTERIZER_OIT_CLEAR - revealage) + behind * revealage) / RASTERIZER_OIT_CLEAR) << (i * 8);
+            }
+
+            rs->functions.set_pixel(rs->functions.userdata, x, y, color);
+        }
+    }
+}
+
+// https://fgiesen.wordpress.com/2013/02/08/triangle-rasterization-in-practice/
+static int rasterizer_min(int v1, int v2)
+{
+    return (v1 < v2) ? v1 : v2;
+}
+
+static int rasterizer_max(int v1, int v2)
+{
+    return (v1 > v2) ? v1 : v2;
+}
+
+static int rasterizer_min3(int v1, int v2, int v3)
+{
+    return rasterizer_min(rasterizer_min(v1, v2), v3);
+}
+
+static int rasterizer_max3(int v1, int v2, int v3)
+{
+    return rasterizer_max(rasterizer_max(v1, v2), v3);
+}
+
+static rasterizer_depth rasterizer_min_depth(rasterizer_depth v1, rasterizer_depth v2)
+{
+    return (v1 < v2) ? v1 : v2;
+}
+
+static rasterizer_depth rasterizer_max_depth(rasterizer_depth v1, rasterizer_depth v2)
+{
+    return (v1 > v2) ? v1 : v2;
+}
+
+// triangles whose bounding box is at most 2x2 pixels skip the tile walk. they are queued per draw, and the coverage
+// of each quad pixel is tested for a whole batch at once, one triangle per lane. the quad's edge values are w, w + a,
+// w + b and w + a + b, so no multiplies are needed.
+#define RASTERIZER_SMALL_BATCH_SIZE (4)
+
+struct rasterizer_small_triangle
+{
+    struct rasterizer_screen_vertex verts[3];
+    struct rasterizer_edge edges[3];
+
+    // top-left pixel of the quad, and which of its pixels (bit dy * 2 + dx) survived clipping
+    int x;
+    int y;
+    unsigned int quad_mask;
+    struct rasterizer_depth_plane depth_plane;
+};
+
+struct rasterizer_small_batch
+{
+    unsigned int count;
+    struct rasterizer_small_triangle triangles[RASTERIZER_SMALL_BATCH_SIZE];
+
+    // [edge][triangle], so each row loads as one vector
+    int w[3][RASTERIZER_SMALL_BATCH_SIZE];
+    int a[3][RASTERIZER_SMALL_BATCH_SIZE];
+    int b[3][RASTERIZER_SMALL_BATCH_SIZE];
+};
+
+static void rasterizer_small_batch_init(struct rasterizer_small_batch *batch)
+{
+    // unused lanes are still tested, keep them defined
+    memset(batch->w, 0, sizeof(batch->w));
+    memset(batch->a, 0, sizeof(batch->a));
+    memset(batch->b, 0, sizeof(batch->b));
+    batch->count = 0;
+}
+
+// rasterizes the queued triangles in the order they were queued
+static void rasterizer_flush_small_triangles(const struct rasterizer_state *rs, struct rasterizer_small_batch *batch)
+{
+    if (batch->count == 0)
+        return;
+
+    // per quad pixel, one coverage bit per triangle
+    unsigned int coverage[4];
+#if defined(USE_SSE2)
+    __m128i w[3], a[3], b[3];
+    for (int e = 0; e < 3; e++)
+    {
+        w[e] = _mm_loadu_si128((const __m128i *)batch->w[e]);
+        a[e] = _mm_loadu_si128((const __m128i *)batch->a[e]);
+        b[e] = _mm_loadu_si128((const __m128i *)batch->b[e]);
+    }
+
+    __m128i minus_one = _mm_set1_epi32(-1);
+    for (int p = 0; p < 4; p++)
+    {
+        __m128i inside = minus_one;
+        for (int e = 0; e < 3; e++)
+        {
+            __m128i value = w[e];
+            if (p & 1)
+                value = _mm_add_epi32(value, a[e]);
+            if (p & 2)
+                value = _mm_add_epi32(value, b[e]);
+
+            inside = _mm_and_si128(inside, _mm_cmpgt_epi32(value, minus_one));
+        }
+
+        coverage[p] = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(inside));
+    }
+#else
+    for (int p = 0; p < 4; p++)
+    {
+        coverage[p] = 0;
+        for (unsigned int t = 0; t < batch->count; t++)
+        {
+            int inside = 1;
+            for (int e = 0; e < 3; e++)
+                inside &= (batch->w[e][t] + ((p & 1) ? batch->a[e][t] : 0) + ((p & 2) ? batch->b[e][t] : 0)) >= 0;
+
+            coverage[p] |= (unsigned int)inside << t;
+        }
+    }
+#endif
+
+    struct rasterizer_depth_buffer *db = rs->depth_buffer;
+    struct rasterizer_visibility_buffer *vb = (db != NULL) ? rs->visibility_buffer : NULL;
+    for (unsigned int t = 0; t < batch->count; t++)
+    {
+        const struct rasterizer_small_triangle *triangle = &batch->triangles[t];
+        const struct rasterizer_screen_vertex *v0 = &triangle->verts[0];
+        const struct rasterizer_screen_vertex *v1 = &triangle->verts[1];
+        const struct rasterizer_screen_vertex *v2 = &triangle->verts[2];
+        unsigned int id = (vb != NULL) ? rasterizer_visibility_add_triangle(rs, vb, v0, v1, v2, triangle->edges) : 0;
+        if (id == RASTERIZER_VISIBILITY_EMPTY)
+            continue;
+
+        for (int p = 0; p < 4; p++)
+        {
+            if (!((coverage[p] >> t) & 1) || !(triangle->quad_mask & (1u << p)))
+                continue;
+
+            int dx = p & 1;
+            int dy = p >> 1;
+            int x = triangle->x + dx;
+            int y = triangle->y + dy;
+            if (db != NULL)
+            {
+                // same test as rasterizer_raster_triangle
+                rasterizer_depth z = rasterizer_depth_at(&triangle->depth_plane, x, y);
+                rasterizer_depth *depth = &db->depth[y * db->width + x];
+                if (!(z >= 0 && z < *depth))
+                    continue;
+
+                *depth = z;
+            }
+
+            if (vb != NULL)
+            {
+                vb->ids[y * vb->width + x] = id;
+                continue;
+            }
+
+            int w0 = batch->w[0][t] + dx * batch->a[0][t] + dy * batch->b[0][t];
+            int w1 = batch->w[1][t] + dx * batch->a[1][t] + dy * batch->b[1][t];
+            int w2 = batch->w[2][t] + dx * batch->a[2][t] + dy * batch->b[2][t];
+            rs->functions.set_pixel(rs->functions.userdata, x, y, rasterizer_shade_pixel(rs, v0, v1, v2, w0, w1, w2));
+        }
+    }
+
+    batch->count = 0;
+}
+
+static void rasterizer_queue_small_triangle(const struct rasterizer_state *rs, struct rasterizer_small_batch *batch, const struct rasterizer_screen_vertex *v0, const struct rasterizer_screen_vertex *v1, const struct rasterizer_screen_vertex *v2, const struct rasterizer_edge edges[3],
+                                            int minX, int minY, int maxX, int maxY, const struct rasterizer_depth_plane *depth_plane)
+{
+    unsigned int t = batch->count++;
+    struct rasterizer_small_triangle *triangle = &batch->triangles[t];
+    triangle->verts[0] = *v0;
+    triangle->verts[1] = *v1;
+    triangle->verts[2] = *v2;
+    memcpy(triangle->edges, edges, sizeof(triangle->edges));
+    triangle->x = minX;
+    triangle->y = minY;
+    triangle->quad_mask = 1u | ((maxX > minX) ? 2u : 0u) | ((maxY > minY) ? 4u : 0u) | ((maxX > minX && maxY > minY) ? 8u : 0u);
+    triangle->depth_plane = *depth_plane;
+    for (int e = 0; e < 3; e++)
+    {
+        batch->w[e][t] = edges[e].a * minX + edges[e].b * minY + edges[e].c;
+        batch->a[e][t] = edges[e].a;
+        batch->b[e][t] = edges[e].b;
+    }
+
+    if (batch->count == RASTERIZER_SMALL_BATCH_SIZE)
+        rasterizer_flush_small_triangles(rs, batch);
+}
+
+// floor(n / d) for positive d, c division truncates towards zero
+static int rasterizer_floor_div(int n, int d)
+{
+    int q = n / d;
+    return ((n % d) != 0 && n < 0) ? (q - 1) : q;
+}
+
+// the pixels of a row inside all three edges are contiguous, and where each edge function crosses zero can be solved for
+// directly, so each row costs the same whatever its length. covers exactly the pixels the per-pixel test would.
+static void rasterizer_raster_triangle_spans(const struct rasterizer_state *rs, const struct rasterizer_screen_vertex *v0, const struct rasterizer_screen_vertex *v1, const struct rasterizer_screen_vertex *v2, const struct rasterizer_edge edges[3],
+                                             int area, int minX, int minY, int maxX, int maxY)
+{
+    struct rasterizer_depth_plane depth_plane;
+    rasterizer_setup_depth_plane(&depth_plane, v0, v1, v2, edges, area);
+    for (int y = minY; y <= maxY; y++)
+    {
+        int x_start = minX;
+        int x_end = maxX;
+        int w_start[3], w_end[3];
+        for (int i = 0; i < 3; i++)
+        {
+            // a * x + r >= 0
+            int r = edges[i].b * y + edges[i].c;
+            if (edges[i].a > 0)
+                x_start = rasterizer_max(x_start, -rasterizer_floor_div(r, edges[i].a));
+            else if (edges[i].a < 0)
+                x_end = rasterizer_min(x_end, rasterizer_floor_div(r, -edges[i].a));
+            else if (r < 0)
+                x_end = x_start - 1;
+        }
+
+        if (x_start > x_end)
+            continue;
+
+        for (int i = 0; i < 3; i++)
+        {
+            w_start[i] = edges[i].a * x_start + edges[i].b * y + edges[i].c;
+            w_end[i] = edges[i].a * x_end + edges[i].b * y + edges[i].c;
+        }
+
+        struct rasterizer_span span;
+        span.y = y;
+        span.x_start = x_start;
+        span.x_end = x_end + 1;
+        span.color_start = rasterizer_shade_pixel(rs, v0, v1, v2, w_start[0], w_start[1], w_start[2]);
+        span.color_end = rasterizer_shade_pixel(rs, v0, v1, v2, w_end[0], w_end[1], w_end[2]);
+        span.z_start = rasterizer_depth_at(&depth_plane, x_start, y);
+        span.z_end = rasterizer_depth_at(&depth_plane, x_end, y);
+        rasterizer_emit_span(rs->span_buffer, &span);
+    }
+}
+
+// edges[0] is v1->v2, edges[1] is v2->v0, edges[2] is v0->v1. batch may be NULL, otherwise small triangles are
+// queued there, and the caller flushes it once the draw is done.
+static void rasterizer_raster_triangle(const struct rasterizer_state *rs, struct rasterizer_small_batch *batch, const struct rasterizer_screen_vertex *v0, const struct rasterizer_screen_vertex *v1, const struct rasterizer_screen_vertex *v2, const struct rasterizer_edge edges[3])
+{
+    // back-facing or degenerate triangles have no pixels inside all three edges
+    int area = edges[2].a * v2->x + edges[2].b * v2->y + edges[2].c;
+    if (area <= 0)
+        return;
+
+    // calculate triangle bounding box
+    int minX = rasterizer_min3(v0->x, v1->x, v2->x);
+    int minY = rasterizer_min3(v0->y, v1->y, v2->y);
+    int maxX = rasterizer_max3(v0->x, v1->x, v2->x);
+    int maxY = rasterizer_max3(v0->y, v1->y, v2->y);
+
+    // clip against the viewport and scissor, and never below zero whatever they say
+    minX = rasterizer_max(minX, rasterizer_max(rs->derived.clip_min[0], 0));
+    maxX = rasterizer_min(maxX, rs->derived.clip_max[0]);
+    minY = rasterizer_max(minY, rasterizer_max(rs->derived.clip_min[1], 0));
+    maxY = rasterizer_min(maxY, rs->derived.clip_max[1]);
+    if (minX > maxX || minY > maxY)
+        return;
+
+    // span output bypasses every buffer and never queues, so nothing is drawn out of order
+    if (rs->span_buffer != NULL)
+    {
+        rasterizer_raster_triangle_spans(rs, v0, v1, v2, edges, area, minX, minY, maxX, maxY);
+        return;
+    }
+
+    // translucent triangles are single sampled, and only test depth
+    struct rasterizer_oit_buffer *ob = rs->oit_buffer;
+    if (ob != NULL)
+    {
+        maxX = rasterizer_min(maxX, ob->width - 1);
+        maxY = rasterizer_min(maxY, ob->height - 1);
+    }
+
+    // multisampled rendering keeps its own per-sample depth, and bypasses the depth buffer's tiles
+    struct rasterizer_msaa_buffer *mb = (ob == NULL) ? rs->msaa_buffer : NULL;
+    struct rasterizer_depth_buffer *db = (mb == NULL) ? rs->depth_buffer : NULL;
+    if (mb != NULL)
+    {
+        maxX = rasterizer_min(maxX, mb->width - 1);
+        maxY = rasterizer_min(maxY, mb->height - 1);
+    }
+
+    int depth_test = (rs->depth_buffer != NULL);
+    struct rasterizer_depth_plane depth_plane;
+    rasterizer_depth zmin = 0;
+    memset(&depth_plane, 0, sizeof(depth_plane));
+    if (depth_test || ob != NULL)
+    {
+        rasterizer_setup_depth_plane(&depth_plane, v0, v1, v2, edges, area);
+        zmin = rasterizer_min_depth(rasterizer_min_depth(v0->z, v1->z), v2->z);
+    }
+
+    if (db != NULL)
+    {
+        maxX = rasterizer_min(maxX, db->width - 1);
+        maxY = rasterizer_min(maxY, db->height - 1);
+    }
+
+    // deferred shading needs the depth test to decide which id survives
+    struct rasterizer_visibility_buffer *vb = (db != NULL && ob == NULL) ? rs->visibility_buffer : NULL;
+    if (vb != NULL)
+    {
+        maxX = rasterizer_min(maxX, vb->width - 1);
+        maxY = rasterizer_min(maxY, vb->height - 1);
+    }
+
+    if (minX > maxX || minY > maxY)
+        return;
+
+    // multisampling needs the sample positions, so only single-sampled triangles take the small path
+    if (batch != NULL)
+    {
+        if (mb == NULL && ob == NULL && (maxX - minX) <= 1 && (maxY - minY) <= 1)
+        {
+            rasterizer_queue_small_triangle(rs, batch, v0, v1, v2, edges, minX, minY, maxX, maxY, &depth_plane);
+            return;
+        }
+
+        // everything queued before this triangle has to be drawn before it
+        rasterizer_flush_small_triangles(rs, batch);
+    }
+
+    unsigned int id = (vb != NULL) ? rasterizer_visibility_add_triangle(rs, vb, v0, v1, v2, edges) : 0;
+    if (id == RASTERIZER_VISIBILITY_EMPTY)
+        return;
+
+    // walk the bounding box in depth tiles, so whole tiles can be skipped when they are outside an edge or behind the stored depth
+    for (int tileY = minY & ~(RASTERIZER_DEPTH_TILE_SIZE - 1); tileY <= maxY; tileY += RASTERIZER_DEPTH_TILE_SIZE)
+    {
+        int y0 = rasterizer_max(tileY, minY);
+        int y1 = rasterizer_min(tileY + RASTERIZER_DEPTH_TILE_SIZE - 1, maxY);
+        for (int tileX = minX & ~(RASTERIZER_DEPTH_TILE_SIZE - 1); tileX <= maxX; tileX += RASTERIZER_DEPTH_TILE_SIZE)
+        {
+            int x0 = rasterizer_max(tileX, minX);
+            int x1 = rasterizer_min(tileX + RASTERIZER_DEPTH_TILE_SIZE - 1, maxX);
+
+            // edge functions are linear, so the corners of the block bound them over the whole block.
+            // samples sit up to 6/16 of a pixel from the centre, which moves the outside limit by as much.
+            int outside = 0;
+            int covered = 1;
+            for (int i = 0; i < 3; i++)
+            {
+                int limit = (mb != NULL) ? -(((abs(edges[i].a) + abs(edges[i].b)) * 6 + 15) / 16) : 0;
+                int w00 = edges[i].a * x0 + edges[i].b * y0 + edges[i].c;
+                int w10 = w00 + edges[i].a * (x1 - x0);
+                int w01 = w00 + edges[i].b * (y1 - y0);
+                int w11 = w10 + edges[i].b * (y1 - y0);
+                outside |= (w00 < limit && w10 < limit && w01 < limit && w11 < limit);
+                covered &= (w00 >= 0 && w10 >= 0 && w01 >= 0 && w11 >= 0);
+            }
+
+            if (outside)
+                continue;
+
+            rasterizer_depth *tile_max = NULL;
+            if (db != NULL)
+            {
+                tile_max = &db->tile_max[(tileY / RASTERIZER_DEPTH_TILE_SIZE) * db->tiles_x + (tileX / RASTERIZER_DEPTH_TILE_SIZE)];
+                if (zmin >= *tile_max)
+                    continue;
+            }
+
+            // rasterize, stepping the edge functions instead of re-evaluating them per pixel
+            int row_w0 = edges[0].a * x0 + edges[0].b * y0 + edges[0].c;
+            int row_w1 = edges[1].a * x0 + edges[1].b * y0 + edges[1].c;
+            int row_w2 = edges[2].a * x0 + edges[2].b * y0 + edges[2].c;
+            for (int y = y0; y <= y1; y++)
+            {
+                int w0 = row_w0;
+                int w1 = row_w1;
+                int w2 = row_w2;
+                for (int x = x0; x <= x1; x++)
+                {
+                    if (mb != NULL)
+                        rasterizer_msaa_shade_pixel(rs, mb, v0, v1, v2, edges, x, y, w0, w1, w2, depth_test, &depth_plane);
+                    else if (w0 >= 0 && w1 >= 0 && w2 >= 0 && ob != NULL)
+                    {
+                        rasterizer_depth z = rasterizer_depth_at(&depth_plane, x, y);
+                        if (db == NULL || (z >= 0 && z < db->depth[y * db->width + x]))
+                            rasterizer_oit_accumulate(ob, x, y, rasterizer_shade_pixel(rs, v0, v1, v2, w0, w1, w2), z);
+                    }
+                    else if (w0 >= 0 && w1 >= 0 && w2 >= 0)
+                    {
+                        int visible = 1;
+                        if (db != NULL)
+                        {
+                            // less-than test, anything in front of the near plane is clipped
+                            rasterizer_depth z = rasterizer_depth_at(&depth_plane, x, y);
+                            rasterizer_depth *depth = &db->depth[y * db->width + x];
+                            visible = (z >= 0 && z < *depth);
+                            if (visible)
+                                *depth = z;
+                        }
+
+                        if (visible && vb != NULL)
+                            vb->ids[y * vb->width + x] = id;
+                        else if (visible)
+                            rs->functions.set_pixel(rs->functions.userdata, x, y, rasterizer_shade_pixel(rs, v0, v1, v2, w0, w1, w2));
+                    }
+
+                    w0 += edges[0].a;
+                    w1 += edges[1].a;
+                    w2 += edges[2].a;
+                }
+
+                row_w0 += edges[0].b;
+                row_w1 += edges[1].b;
+                row_w2 += edges[2].b;
+            }
+
+            // every pixel of a fully covered tile now holds at most the triangle's depth there, which peaks at a corner.
+            // tiles which are partially covered, or reach in front of the near plane, keep their old (still conservative) maximum.
+            if (tile_max != NULL && covered && ob == NULL &&
+                x0 == tileX && x1 == rasterizer_min(tileX + RASTERIZER_DEPTH_TILE_SIZE - 1, db->width - 1) &&
+                y0 == tileY && y1 == rasterizer_min(tileY + RASTERIZER_DEPTH_TILE_SIZE - 1, db->height - 1))
+            {
+                rasterizer_depth z00 = rasterizer_depth_at(&depth_plane, x0, y0);
+                rasterizer_depth z10 = rasterizer_depth_at(&depth_plane, x1, y0);
+                rasterizer_depth z01 = rasterizer_depth_at(&depth_plane, x0, y1);
+                rasterizer_depth z11 = rasterizer_depth_at(&depth_plane, x1, y1);
+                rasterizer_depth corner_min = rasterizer_min_depth(rasterizer_min_depth(z00, z10), rasterizer_min_depth(z01, z11));
+                rasterizer_depth corner_max = rasterizer_max_depth(rasterizer_max_depth(z00, z10), rasterizer_max_depth(z01, z11));
+                if (corner_min >= 0 && corner_max < *tile_max)
+                    *tile_max = corner_max;
+            }
+        }
+    }
+}
+
+void rasterizer_draw_triangle(struct rasterizer_state *rs, const rasterizer_vertex verts[3])
+{
+    // transform to viewport space with the cached world/view/projection matrix
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        struct rasterizer_screen_vertex projected_vertices[3];
+        for (int i = 0; i < 3; i++)
+            rasterizer_snap_vertex(rs, &verts[i], &projected_vertices[i]);
+
+        struct rasterizer_edge edges[3];
+        rasterizer_setup_edge(&edges[0], &projected_vertices[1], &projected_vertices[2]);
+        rasterizer_setup_edge(&edges[1], &projected_vertices[2], &projected_vertices[0]);
+        rasterizer_setup_edge(&edges[2], &projected_vertices[0], &projected_vertices[1]);
+        rasterizer_raster_triangle(rs, NULL, &projected_vertices[0], &projected_vertices[1], &projected_vertices[2], edges);
+    }
+}
+
+static void rasterizer_draw_primitives(const struct rasterizer_state *rs, enum rasterizer_topology topology, const struct rasterizer_vertex_source *source, const unsigned int *indices, size_t count)
+{
+    struct rasterizer_vertex_cache cache;
+    memset(cache.tags, 0xFF, sizeof(cache.tags));
+
+    // window holds the vertices carried over to the next triangle: the last two for strips, the first and last for fans
+    struct rasterizer_screen_vertex window[3];
+    struct rasterizer_edge edges[3];
+    struct rasterizer_edge shared_edge;
+    size_t nassembled = 0;
+
+    struct rasterizer_small_batch small_triangles;
+    rasterizer_small_batch_init(&small_triangles);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned int index = (indices != NULL) ? indices[i] : (unsigned int)i;
+        if (indices != NULL && index == RASTERIZER_PRIMITIVE_RESTART_INDEX)
+        {
+            nassembled = 0;
+            continue;
+        }
+
+        // copy out of the cache, a later fetch may evict the slot
+        unsigned int slot = index % RASTERIZER_VERTEX_CACHE_SIZE;
+        if (cache.tags[slot] != index)
+        {
+            rasterizer_fetch_vertex(rs, source, index, &cache.entries[slot]);
+            cache.tags[slot] = index;
+        }
+
+        struct rasterizer_screen_vertex vertex = cache.entries[slot];
+        if (topology == RASTERIZER_TOPOLOGY_TRIANGLE_LIST)
+        {
+            window[nassembled % 3] = vertex;
+            if ((++nassembled % 3) != 0)
+                continue;
+
+            rasterizer_setup_edge(&edges[0], &window[1], &window[2]);
+            rasterizer_setup_edge(&edges[1], &window[2], &window[0]);
+            rasterizer_setup_edge(&edges[2], &window[0], &window[1]);
+            rasterizer_raster_triangle(rs, &small_triangles, &window[0], &window[1], &window[2], edges);
+            continue;
+        }
+
+        if (nassembled < 2)
+        {
+            window[nassembled++] = vertex;
+            continue;
+        }
+
+        // consecutive triangles share an edge, which only needs negating rather than setting up again
+        size_t triangle = nassembled - 2;
+        if (topology == RASTERIZER_TOPOLOGY_TRIANGLE_STRIP)
+        {
+            // odd triangles swap their first two vertices to keep the winding consistent
+            const struct rasterizer_screen_vertex *a = (triangle & 1) ? &window[1] : &window[0];
+            const struct rasterizer_screen_vertex *b = (triangle & 1) ? &window[0] : &window[1];
+            rasterizer_setup_edge(&edges[0], b, &vertex);
+            rasterizer_setup_edge(&edges[1], &vertex, a);
+            if (triangle == 0)
+                rasterizer_setup_edge(&edges[2], a, b);
+            else
+                edges[2] = shared_edge;
+
+            rasterizer_raster_triangle(rs, &small_triangles, a, b, &vertex, edges);
+            rasterizer_flip_edge(&shared_edge, (triangle & 1) ? &edges[1] : &edges[0]);
+            window[0] = window[1];
+            window[1] = vertex;
+        }
+        else
+        {
+            rasterizer_setup_edge(&edges[0], &window[1], &vertex);
+            rasterizer_setup_edge(&edges[1], &vertex, &window[0]);
+            if (triangle == 0)
+                rasterizer_setup_edge(&edges[2], &window[0], &window[1]);
+            else
+                edges[2] = shared_edge;
+
+            rasterizer_raster_triangle(rs, &small_triangles, &window[0], &window[1], &vertex, edges);
+            rasterizer_flip_edge(&shared_edge, &edges[1]);
+            window[1] = vertex;
+        }
+
+        nassembled++;
+    }
+
+    rasterizer_flush_small_triangles(rs, &small_triangles);
+}
+
+// draws smaller than two chunks are not worth handing to the job pool
+#define RASTERIZER_CHUNK_TRIANGLES (4096)
+#define RASTERIZER_CHUNK_VERTICES (RASTERIZER_CHUNK_TRIANGLES * 3)
+
+struct rasterizer_parallel_xform
+{
+    const struct rasterizer_state *rs;
+    const rasterizer_vertex *verts;
+    size_t nverts;
+    struct rasterizer_screen_vertex *screen_verts;
+
+    // per triangle of a list, zero for back-facing and off-screen triangles. NULL for strips and fans.
+    unsigned char *visible;
+};
+
+static void rasterizer_parallel_xform_chunk(void *context, unsigned int chunk)
+{
+    struct rasterizer_parallel_xform *px = (struct rasterizer_parallel_xform *)context;
+    const struct rasterizer_state *rs = px->rs;
+
+    // each chunk owns its own range of the output, so no synchronization is needed
+    size_t first = (size_t)chunk * RASTERIZER_CHUNK_VERTICES;
+    size_t last = (first + RASTERIZER_CHUNK_VERTICES < px->nverts) ? (first + RASTERIZER_CHUNK_VERTICES) : px->nverts;
+    for (size_t i = first; i < last; i++)
+        rasterizer_snap_vertex(rs, &px->verts[i], &px->screen_verts[i]);
+
+    if (px->visible == NULL)
+        return;
+
+    for (size_t i = first; (i + 2) < last; i += 3)
+    {
+        const struct rasterizer_screen_vertex *v0 = &px->screen_verts[i];
+        const struct rasterizer_screen_vertex *v1 = &px->screen_verts[i + 1];
+        const struct rasterizer_screen_vertex *v2 = &px->screen_verts[i + 2];
+
+        // same area test as rasterizer_raster_triangle, plus the bounding box against the viewport and scissor
+        const int *clip_min = rs->derived.clip_min;
+        const int *clip_max = rs->derived.clip_max;
+        struct rasterizer_edge edge;
+        rasterizer_setup_edge(&edge, v0, v1);
+        int area = edge.a * v2->x + edge.b * v2->y + edge.c;
+        int offscreen = (v0->x < clip_min[0] && v1->x < clip_min[0] && v2->x < clip_min[0]) ||
+                        (v0->y < clip_min[1] && v1->y < clip_min[1] && v2->y < clip_min[1]) ||
+                        (v0->x > clip_max[0] && v1->x > clip_max[0] && v2->x > clip_max[0]) ||
+                        (v0->y > clip_max[1] && v1->y > clip_max[1] && v2->y > clip_max[1]);
+        px->visible[i / 3] = (area > 0 && !offscreen);
+    }
+}
+
+// transforms a large draw's vertices on the job pool, into the context's scratch memory. returns NULL, leaving the draw
+// to the serial path, if there is no pool, the draw is too small, or memory ran out.
+static struct rasterizer_screen_vertex *rasterizer_parallel_xform(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, unsigned char **visible)
+{
+    if (rs->job_pool == NULL || nverts < (RASTERIZER_CHUNK_VERTICES * 2))
+        return NULL;
+
+    // the visibility flags go after the vertices
+    size_t verts_size = sizeof(struct rasterizer_screen_vertex) * nverts;
+    unsigned char *scratch = (unsigned char *)rasterizer_get_scratch(rs, verts_size + ((visible != NULL) ? (nverts / 3) : 0));
+    if (scratch == NULL)
+        return NULL;
+
+    struct rasterizer_parallel_xform px;
+    px.rs = rs;
+    px.verts = verts;
+    px.nverts = nverts;
+    px.screen_verts = (struct rasterizer_screen_vertex *)scratch;
+    px.visible = (visible != NULL) ? (scratch + verts_size) : NULL;
+
+    unsigned int nchunks = (unsigned int)((nverts + RASTERIZER_CHUNK_VERTICES - 1) / RASTERIZER_CHUNK_VERTICES);
+    job_pool_run(rs->job_pool, rasterizer_parallel_xform_chunk, &px, nchunks);
+    if (visible != NULL)
+        *visible = px.visible;
+
+    return px.screen_verts;
+}
+
+void rasterizer_draw_triangle_list(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        unsigned char *visible;
+        struct rasterizer_screen_vertex *screen_verts = rasterizer_parallel_xform(rs, verts, nverts, &visible);
+        if (screen_verts == NULL)
+        {
+            struct rasterizer_vertex_source source = { .verts = verts };
+            rasterizer_draw_primitives(rs, RASTERIZER_TOPOLOGY_TRIANGLE_LIST, &source, NULL, nverts - (nverts % 3));
+            continue;
+        }
+
+        // rasterization stays on this thread, in submission order
+        struct rasterizer_small_batch small_triangles;
+        rasterizer_small_batch_init(&small_triangles);
+        for (size_t i = 0; (i + 2) < nverts; i += 3)
+        {
+            if (!visible[i / 3])
+                continue;
+
+            struct rasterizer_edge edges[3];
+            rasterizer_setup_edge(&edges[0], &screen_verts[i + 1], &screen_verts[i + 2]);
+            rasterizer_setup_edge(&edges[1], &screen_verts[i + 2], &screen_verts[i]);
+            rasterizer_setup_edge(&edges[2], &screen_verts[i], &screen_verts[i + 1]);
+            rasterizer_raster_triangle(rs, &small_triangles, &screen_verts[i], &screen_verts[i + 1], &screen_verts[i + 2], edges);
+        }
+
+        rasterizer_flush_small_triangles(rs, &small_triangles);
+    }
+}
+
+// strips and fans share vertices between triangles, so only the transform is spread out
+static void rasterizer_draw_connected(struct rasterizer_state *rs, enum rasterizer_topology topology, const rasterizer_vertex *verts, size_t nverts)
+{
+    struct rasterizer_screen_vertex *screen_verts = rasterizer_parallel_xform(rs, verts, nverts, NULL);
+    struct rasterizer_vertex_source source = { .verts = verts, .screen_verts = screen_verts };
+    rasterizer_draw_primitives(rs, topology, &source, NULL, nverts);
+}
+
+void rasterizer_draw_triangle_strip(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        rasterizer_draw_connected(rs, RASTERIZER_TOPOLOGY_TRIANGLE_STRIP, verts, nverts);
+    }
+}
+
+void rasterizer_draw_triangle_fan(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        rasterizer_draw_connected(rs, RASTERIZER_TOPOLOGY_TRIANGLE_FAN, verts, nverts);
+    }
+}
+
+void rasterizer_draw_indexed_triangle_list(struct rasterizer_state *rs, const rasterizer_vertex *verts, const unsigned int *indices, size_t nindices)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        struct rasterizer_vertex_source source = { .verts = verts };
+        rasterizer_draw_primitives(rs, RASTERIZER_TOPOLOGY_TRIANGLE_LIST, &source, indices, nindices);
+    }
+}
+
+void rasterizer_draw_indexed_triangle_strip(struct rasterizer_state *rs, const rasterizer_vertex *verts, const unsigned int *indices, size_t nindices)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        struct rasterizer_vertex_source source = { .verts = verts };
+        rasterizer_draw_primitives(rs, RASTERIZER_TOPOLOGY_TRIANGLE_STRIP, &source, indices, nindices);
+    }
+}
+
+void rasterizer_draw_indexed_triangle_fan(struct rasterizer_state *rs, const rasterizer_vertex *verts, const unsigned int *indices, size_t nindices)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        struct rasterizer_vertex_source source = { .verts = verts };
+        rasterizer_draw_primitives(rs, RASTERIZER_TOPOLOGY_TRIANGLE_FAN, &source, indices, nindices);
+    }
+}
+
+void rasterizer_draw_packed_indexed_triangle_list(struct rasterizer_state *rs, const rasterizer_packed_vertex *verts, const float scale[3], const float bias[3], const unsigned int *indices, size_t nindices)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        struct rasterizer_vertex_source source = { .packed_verts = verts, .scale = scale, .bias = bias };
+#if RASTERIZER_FIXED_POINT
+        for (int axis = 0; axis < 3; axis++)
+        {
+            source.fixed_scale[axis] = fixed_from_float(scale[axis]);
+            source.fixed_bias[axis] = fixed_from_float(bias[axis]);
+        }
+#endif
+        rasterizer_draw_primitives(rs, RASTERIZER_TOPOLOGY_TRIANGLE_LIST, &source, indices, nindices);
+    }
+}
+
+// true when every triangle of the meshlet faces away from the camera. triangles facing the camera are wound
+// counter-clockwise in object space (in a right-handed space, with an unmirrored transform), so their normals
+// point back at it.
+static int rasterizer_meshlet_backfacing(const struct rasterizer_derived_state *derived, const struct rasterizer_meshlet *meshlet)
+{
+    if (meshlet->cone_cutoff >= 1.0f)
+        return 0;
+
+    const vec4 *eye = &derived->object_eye;
+    float axis[3];
+    for (int i = 0; i < 3; i++)
+        axis[i] = meshlet->cone_axis[i] * derived->object_facing;
+
+    // orthographic, every view ray has the same direction
+    if (eye->w == 0.0f)
+        return (eye->x * axis[0] + eye->y * axis[1] + eye->z * axis[2]) >= meshlet->cone_cutoff;
+
+    // the radius allows for the triangles being anywhere in the sphere rather than at its centre
+    float view[3] = { meshlet->center[0] - eye->x, meshlet->center[1] - eye->y, meshlet->center[2] - eye->z };
+    float distance = sqrtf(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+    return (view[0] * axis[0] + view[1] * axis[1] + view[2] * axis[2]) >= (meshlet->cone_cutoff * distance + meshlet->radius);
+}
+
+void rasterizer_draw_packed_meshlets(struct rasterizer_state *rs, const rasterizer_packed_vertex *verts, const float scale[3], const float bias[3], const unsigned int *indices, const struct rasterizer_meshlet *meshlets, size_t nmeshlets)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        if (!rasterizer_begin_draw(rs))
+            continue;
+
+        struct rasterizer_vertex_source source = { .packed_verts = verts, .scale = scale, .bias = bias };
+#if RASTERIZER_FIXED_POINT
+        for (int axis = 0; axis < 3; axis++)
+        {
+            source.fixed_scale[axis] = fixed_from_float(scale[axis]);
+            source.fixed_bias[axis] = fixed_from_float(bias[axis]);
+        }
+#endif
+        const struct rasterizer_derived_state *derived = &rs->derived;
+        for (size_t i = 0; i < nmeshlets; i++)
+        {
+            const struct rasterizer_meshlet *meshlet = &meshlets[i];
+            struct rasterizer_bounds bounds;
+            bounds.type = RASTERIZER_BOUNDS_SPHERE;
+            memcpy(bounds.center, meshlet->center, sizeof(bounds.center));
+            memset(bounds.extents, 0, sizeof(bounds.extents));
+            bounds.radius = meshlet->radius;
+
+            // cheapest first, the occlusion test projects the sphere's box
+            if (!rasterizer_bounds_in_frustum(&bounds, derived->object_planes) ||
+                rasterizer_meshlet_backfacing(derived, meshlet) ||
+                rasterizer_bounds_occluded(rs, &bounds, &derived->world_view_projection))
+            {
+                continue;
+            }
+
+            rasterizer_draw_primitives(rs, RASTERIZER_TOPOLOGY_TRIANGLE_LIST, &source, indices + meshlet->first_index, (size_t)meshlet->triangle_count * 3);
+        }
+    }
+}
+
+// vertices transformed per step of the instanced paths, a multiple of both 2 and 3 so lines and triangles never straddle batches
+#define RASTERIZER_BATCH_SIZE (96)
+
+// stack space for pre-transformed vertices of indexed instanced draws, larger meshes use the context's scratch memory
+#define RASTERIZER_INSTANCE_STACK_VERTS (256)
+
+static unsigned int rasterizer_modulate_color(unsigned int color1, unsigned int color2)
+{
+    unsigned int result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        unsigned int c = ((color1 >> shift) & 0xFF) * ((color2 >> shift) & 0xFF);
+        result |= ((c + 255) >> 8) << shift;
+    }
+
+    return result;
+}
+
+// the bounds are in the space of each instance's matrix, so they are tested against that instance's frustum
+static int rasterizer_instance_visible(const struct rasterizer_state *rs, const mat4x4 *combined)
+{
+    if (!rs->has_bounds)
+        return 1;
+
+    vec4 planes[RASTERIZER_FRUSTUM_PLANE_COUNT];
+    rasterizer_extract_planes(planes, combined);
+    return rasterizer_bounds_in_frustum(&rs->bounds, planes) && !rasterizer_bounds_occluded(rs, &rs->bounds, combined);
+}
+
+#if !RASTERIZER_FIXED_POINT
+// transforms straight to viewport space with an already concatenated world/view/projection matrix
+static void rasterizer_xform_batch(const struct rasterizer_state *rs, const mat4x4 *combined, const rasterizer_vertex *in_verts, size_t count, unsigned int color, rasterizer_vertex *out_verts)
+{
+    float scale_x = rs->derived.viewport_scale[0];
+    float scale_y = rs->derived.viewport_scale[1];
+    float offset_x = rs->derived.viewport_offset[0];
+    float offset_y = rs->derived.viewport_offset[1];
+    size_t i = 0;
+
+#if defined(USE_SSE2)
+    // four vertices at a time, transposed so each register holds one component of all four
+    __m128 m[4][4];
+    for (int row = 0; row < 4; row++)
+    {
+        for (int col = 0; col < 4; col++)
+            m[row][col] = _mm_set1_ps(combined->data[row][col]);
+    }
+
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 scale_x4 = _mm_set1_ps(scale_x);
+    __m128 scale_y4 = _mm_set1_ps(scale_y);
+    __m128 offset_x4 = _mm_set1_ps(offset_x);
+    __m128 offset_y4 = _mm_set1_ps(offset_y);
+    for (; (i + 4) <= count; i += 4)
+    {
+        __m128 xs = _mm_loadu_ps(&in_verts[i + 0].x);
+        __m128 ys = _mm_loadu_ps(&in_verts[i + 1].x);
+        __m128 zs = _mm_loadu_ps(&in_verts[i + 2].x);
+        __m128 colors = _mm_loadu_ps(&in_verts[i + 3].x);
+        _MM_TRANSPOSE4_PS(xs, ys, zs, colors);
+
+        __m128 clip[4];
+        for (int row = 0; row < 4; row++)
+        {
+            clip[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[row][0], xs), _mm_mul_ps(m[row][1], ys)),
+                                   _mm_add_ps(_mm_mul_ps(m[row][2], zs), m[row][3]));
+        }
+
+        __m128 rcp_w = _mm_div_ps(one, clip[3]);
+        __m128 out_x = _mm_add_ps(offset_x4, _mm_mul_ps(_mm_mul_ps(clip[0], rcp_w), scale_x4));
+        __m128 out_y = _mm_add_ps(offset_y4, _mm_mul_ps(_mm_mul_ps(clip[1], rcp_w), scale_y4));
+        __m128 out_z = _mm_mul_ps(clip[2], rcp_w);
+        _MM_TRANSPOSE4_PS(out_x, out_y, out_z, colors);
+        _mm_storeu_ps(&out_verts[i + 0].x, out_x);
+        _mm_storeu_ps(&out_verts[i + 1].x, out_y);
+        _mm_storeu_ps(&out_verts[i + 2].x, out_z);
+        _mm_storeu_ps(&out_verts[i + 3].x, colors);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        vec4 temp;
+        vec4_set(&temp, in_verts[i].x, in_verts[i].y, in_verts[i].z, 1.0f);
+        mat4x4_mul_vec4(&temp, combined, &temp);
+
+        float rcp_w = 1.0f / temp.w;
+        out_verts[i].x = offset_x + temp.x * rcp_w * scale_x;
+        out_verts[i].y = offset_y + temp.y * rcp_w * scale_y;
+        out_verts[i].z = temp.z * rcp_w;
+        out_verts[i].color = in_verts[i].color;
+    }
+
+    if (color != 0xFFFFFFFF)
+    {
+        for (i = 0; i < count; i++)
+            out_verts[i].color = rasterizer_modulate_color(out_verts[i].color, color);
+    }
+}
+#endif
+
+// transforms and snaps for triangles, batch is where the float path keeps the unsnapped vertices
+static void rasterizer_snap_batch(const struct rasterizer_state *rs, const mat4x4 *combined, const rasterizer_vertex *in_verts, size_t count, unsigned int color, rasterizer_vertex *batch, struct rasterizer_screen_vertex *out_verts)
+{
+#if RASTERIZER_FIXED_POINT
+    fixed_mat4x4 fixed_combined;
+    fixed_mat4x4_from_mat4x4(&fixed_combined, combined);
+    for (size_t i = 0; i < count; i++)
+    {
+        fixed_vec4 position;
+        rasterizer_load_fixed_position(&position, &in_verts[i]);
+        unsigned int vertex_color = (color != 0xFFFFFFFF) ? rasterizer_modulate_color(in_verts[i].color, color) : in_verts[i].color;
+        rasterizer_project_fixed(&rs->derived, &fixed_combined, &position, vertex_color, &out_verts[i]);
+    }
+
+    (void)batch;
+#else
+    rasterizer_xform_batch(rs, combined, in_verts, count, color, batch);
+    for (size_t i = 0; i < count; i++)
+        rasterizer_snap_projected_vertex(&batch[i], &out_verts[i]);
+#endif
+}
+
+static void rasterizer_draw_instanced(const struct rasterizer_state *rs, int lines, const rasterizer_vertex *verts, size_t nverts, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances)
+{
+    // view and projection are shared, so each instance costs one matrix concatenation
+    const mat4x4 *view_projection = &rs->derived.view_projection;
+
+    rasterizer_vertex batch[RASTERIZER_BATCH_SIZE];
+    struct rasterizer_screen_vertex screen_batch[RASTERIZER_BATCH_SIZE];
+    struct rasterizer_small_batch small_triangles;
+    rasterizer_small_batch_init(&small_triangles);
+    for (size_t instance = 0; instance < ninstances; instance++)
+    {
+        mat4x4 combined;
+        mat4x4_mul(&combined, view_projection, &instance_matrices[instance]);
+        if (!rasterizer_instance_visible(rs, &combined))
+            continue;
+
+        unsigned int color = (instance_colors != NULL) ? instance_colors[instance] : 0xFFFFFFFF;
+
+        for (size_t start = 0; start < nverts; start += RASTERIZER_BATCH_SIZE)
+        {
+            size_t count = nverts - start;
+            if (count > RASTERIZER_BATCH_SIZE)
+                count = RASTERIZER_BATCH_SIZE;
+
+            if (lines)
+            {
+#if RASTERIZER_FIXED_POINT
+                fixed_mat4x4 fixed_combined;
+                fixed_mat4x4_from_mat4x4(&fixed_combined, &combined);
+                for (size_t i = 0; (i + 2) <= count; i += 2)
+                {
+                    fixed_vec4 position;
+                    fixed line_start[3], line_end[3];
+                    rasterizer_load_fixed_position(&position, &verts[start + i]);
+                    rasterizer_xform_fixed(&rs->derived, &fixed_combined, &position, line_start);
+                    rasterizer_load_fixed_position(&position, &verts[start + i + 1]);
+                    rasterizer_xform_fixed(&rs->derived, &fixed_combined, &position, line_end);
+                    unsigned int start_color = (color != 0xFFFFFFFF) ? rasterizer_modulate_color(verts[start + i].color, color) : verts[start + i].color;
+                    unsigned int end_color = (color != 0xFFFFFFFF) ? rasterizer_modulate_color(verts[start + i + 1].color, color) : verts[start + i + 1].color;
+                    rasterizer_draw_fixed_line(rs, line_start, start_color, line_end, end_color);
+                }
+#else
+                rasterizer_xform_batch(rs, &combined, verts + start, count, color, batch);
+                for (size_t i = 0; (i + 2) <= count; i += 2)
+                    rasterizer_draw_projected_line(rs, &batch[i], &batch[i + 1]);
+#endif
+
+                continue;
+            }
+
+            rasterizer_snap_batch(rs, &combined, verts + start, count, color, batch, screen_batch);
+            for (size_t i = 0; (i + 3) <= count; i += 3)
+            {
+                const struct rasterizer_screen_vertex *triangle = &screen_batch[i];
+                struct rasterizer_edge edges[3];
+                rasterizer_setup_edge(&edges[0], &triangle[1], &triangle[2]);
+                rasterizer_setup_edge(&edges[1], &triangle[2], &triangle[0]);
+                rasterizer_setup_edge(&edges[2], &triangle[0], &triangle[1]);
+                rasterizer_raster_triangle(rs, &small_triangles, &triangle[0], &triangle[1], &triangle[2], edges);
+            }
+        }
+    }
+
+    rasterizer_flush_small_triangles(rs, &small_triangles);
+}
+
+static void rasterizer_draw_indexed_instanced(struct rasterizer_state *rs, enum rasterizer_topology topology, const rasterizer_vertex *verts, size_t nverts, const unsigned int *indices, size_t nindices, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances)
+{
+    const mat4x4 *view_projection = &rs->derived.view_projection;
+
+    // every vertex is transformed once per instance up front, then assembled from the transformed copy
+    struct rasterizer_screen_vertex stack_verts[RASTERIZER_INSTANCE_STACK_VERTS];
+    struct rasterizer_screen_vertex *screen_verts = stack_verts;
+    if (nverts > RASTERIZER_INSTANCE_STACK_VERTS)
+    {
+        screen_verts = (struct rasterizer_screen_vertex *)rasterizer_get_scratch(rs, sizeof(struct rasterizer_screen_vertex) * nverts);
+        if (screen_verts == NULL)
+            return;
+    }
+
+    struct rasterizer_vertex_source source = { .screen_verts = screen_verts };
+    rasterizer_vertex batch[RASTERIZER_BATCH_SIZE];
+    for (size_t instance = 0; instance < ninstances; instance++)
+    {
+        mat4x4 combined;
+        mat4x4_mul(&combined, view_projection, &instance_matrices[instance]);
+        if (!rasterizer_instance_visible(rs, &combined))
+            continue;
+
+        unsigned int color = (instance_colors != NULL) ? instance_colors[instance] : 0xFFFFFFFF;
+
+        for (size_t start = 0; start < nverts; start += RASTERIZER_BATCH_SIZE)
+        {
+            size_t count = nverts - start;
+            if (count > RASTERIZER_BATCH_SIZE)
+                count = RASTERIZER_BATCH_SIZE;
+
+            rasterizer_snap_batch(rs, &combined, verts + start, count, color, batch, screen_verts + start);
+        }
+
+        rasterizer_draw_primitives(rs, topology, &source, indices, nindices);
+    }
+}
+
+void rasterizer_draw_line_list_instanced(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        rasterizer_get_derived_state(rs);
+        if (rs->visibility_buffer != NULL)
+            rs->visibility_buffer->new_draw = 1;
+
+        rasterizer_draw_instanced(rs, 1, verts, nverts, instance_matrices, instance_colors, ninstances);
+    }
+}
+
+void rasterizer_draw_triangle_list_instanced(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        rasterizer_get_derived_state(rs);
+        if (rs->visibility_buffer != NULL)
+            rs->visibility_buffer->new_draw = 1;
+
+        rasterizer_draw_instanced(rs, 0, verts, nverts, instance_matrices, instance_colors, ninstances);
+    }
+}
+
+void rasterizer_draw_indexed_triangle_list_instanced(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, const unsigned int *indices, size_t nindices, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        rasterizer_get_derived_state(rs);
+        if (rs->visibility_buffer != NULL)
+            rs->visibility_buffer->new_draw = 1;
+
+        rasterizer_draw_indexed_instanced(rs, RASTERIZER_TOPOLOGY_TRIANGLE_LIST, verts, nverts, indices, nindices, instance_matrices, instance_colors, ninstances);
+    }
+}
+
+void rasterizer_draw_indexed_triangle_strip_instanced(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, const unsigned int *indices, size_t nindices, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances)
+{
+    unsigned int viewports = rasterizer_get_viewport_mask(rs);
+    while (rasterizer_next_viewport(rs, &viewports))
+    {
+        rasterizer_get_derived_state(rs);
+        if (rs->visibility_buffer != NULL)
+            rs->visibility_buffer->new_draw = 1;
+
+        rasterizer_draw_indexed_instanced(rs, RASTERIZER_TOPOLOGY_TRIANGLE_STRIP, verts, nverts, indices, nindices, instance_matrices, instance_colors, ninstances);
+    }
+}
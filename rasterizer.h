@@ -1,10 +1,12 @@
 #pragma once
 #include "minimath.h"
+#include "fixed.h"
 #include <stdlib.h>
 
 typedef void(*rs_clear_fn)(void *userdata);
 typedef void(*rs_set_pixel_fn)(void *userdata, int x, int y, unsigned int color);
 typedef void(*rs_present_fn)(void *userdata);
+typedef unsigned int(*rs_get_pixel_fn)(void *userdata, int x, int y);
 
 struct viewport_state
 {
@@ -14,22 +16,313 @@ struct viewport_state
     int height;
 };
 
+// pixel rectangle, used for scissoring
+struct rasterizer_rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
 struct rasterizer_functions
 {
     rs_clear_fn clear;
     rs_set_pixel_fn set_pixel;
     rs_present_fn present;
+
+    // optional, reads a pixel back so translucent pixels can be composited over it (NULL composites over black)
+    rs_get_pixel_fn get_pixel;
     void *userdata;
 };
 
+// per-context options, see rasterizer_set_flags
+#define RASTERIZER_FLAG_COLOR_INTERPOLATION (1 << 0)
+
+// which inputs of the derived state have changed since it was last built
+#define RASTERIZER_DIRTY_WORLD (1 << 0)
+#define RASTERIZER_DIRTY_VIEW (1 << 1)
+#define RASTERIZER_DIRTY_PROJECTION (1 << 2)
+#define RASTERIZER_DIRTY_VIEWPORT (1 << 3)
+#define RASTERIZER_DIRTY_BOUNDS (1 << 4)
+#define RASTERIZER_DIRTY_SCISSOR (1 << 5)
+#define RASTERIZER_DIRTY_ALL (RASTERIZER_DIRTY_WORLD | RASTERIZER_DIRTY_VIEW | RASTERIZER_DIRTY_PROJECTION | RASTERIZER_DIRTY_VIEWPORT | RASTERIZER_DIRTY_BOUNDS | RASTERIZER_DIRTY_SCISSOR)
+
+// size of the viewport array, see rasterizer_set_viewports
+#define RASTERIZER_MAX_VIEWPORTS (16)
+
+// indices into the frustum plane arrays
+enum rasterizer_frustum_plane
+{
+    RASTERIZER_FRUSTUM_LEFT,
+    RASTERIZER_FRUSTUM_RIGHT,
+    RASTERIZER_FRUSTUM_BOTTOM,
+    RASTERIZER_FRUSTUM_TOP,
+    RASTERIZER_FRUSTUM_NEAR,
+    RASTERIZER_FRUSTUM_FAR,
+    RASTERIZER_FRUSTUM_PLANE_COUNT,
+};
+
+enum rasterizer_bounds_type
+{
+    RASTERIZER_BOUNDS_BOX,
+    RASTERIZER_BOUNDS_SPHERE,
+};
+
+// bounding volume of a draw's vertices, before the world (or instance) matrix is applied
+struct rasterizer_bounds
+{
+    enum rasterizer_bounds_type type;
+    float center[3];
+    float extents[3];   // half-size per axis, boxes only
+    float radius;       // spheres only
+};
+
+// everything computed from the matrices and viewport, rebuilt on the first draw after one of them changes
+struct rasterizer_derived_state
+{
+    mat4x4 view_projection;
+    mat4x4 world_view_projection;
+
+    // ndc to viewport space, x' = x * scale + offset
+    float viewport_scale[2];
+    float viewport_offset[2];
+
+#if RASTERIZER_FIXED_POINT
+    // the same, for the integer vertex transform
+    fixed_mat4x4 fixed_world_view_projection;
+    fixed fixed_viewport_scale[2];
+    fixed fixed_viewport_offset[2];
+#endif
+
+    // pixels draws may touch, the viewport intersected with the scissor. inclusive, empty if min > max.
+    int clip_min[2];
+    int clip_max[2];
+
+    // normalized planes, (x, y, z) . n + w >= 0 on the inside. world_planes are in world space,
+    // object_planes in the space the world matrix transforms from.
+    vec4 world_planes[RASTERIZER_FRUSTUM_PLANE_COUNT];
+    vec4 object_planes[RASTERIZER_FRUSTUM_PLANE_COUNT];
+
+    // the camera in the space the world matrix transforms from: a point (w = 1), or under an orthographic projection
+    // the unit direction it looks in (w = 0). object_facing is -1 if the transform mirrors, flipping which side of a
+    // triangle faces the camera, and 1 otherwise.
+    vec4 object_eye;
+    float object_facing;
+
+    // whether the current bounds intersect the frustum, always true without bounds
+    int bounds_visible;
+};
+
+// stored depth, 0 (near) to RASTERIZER_DEPTH_ONE (far)
+#if RASTERIZER_FIXED_POINT
+typedef fixed rasterizer_depth;
+#define RASTERIZER_DEPTH_ONE (FIXED_ONE)
+#else
+typedef float rasterizer_depth;
+#define RASTERIZER_DEPTH_ONE (1.0f)
+#endif
+
+// depth tiles are square, a power of two, and aligned to the screen origin
+#define RASTERIZER_DEPTH_TILE_SIZE (8)
+#define RASTERIZER_HIZ_MAX_LEVELS (16)
+
+// caller-owned depth buffer, cleared to RASTERIZER_DEPTH_ONE (far). triangles pass where their interpolated z is >= 0 and less than
+// what is stored. lines are neither tested nor written.
+struct rasterizer_depth_buffer
+{
+    int width;
+    int height;
+    rasterizer_depth *depth;
+
+    // upper bound of each tile's depth, lowered whenever a triangle covers a whole tile. triangles
+    // whose nearest vertex is no closer than this skip the tile without visiting its pixels.
+    int tiles_x;
+    int tiles_y;
+    rasterizer_depth *tile_max;
+
+    // max-reduction pyramid from rasterizer_build_hiz, one texel per tile at level 0, halving down to 1x1.
+    // only used by occlusion queries, and only until the next clear.
+    int hiz_levels;
+    int hiz_width[RASTERIZER_HIZ_MAX_LEVELS];
+    int hiz_height[RASTERIZER_HIZ_MAX_LEVELS];
+    rasterizer_depth *hiz[RASTERIZER_HIZ_MAX_LEVELS];
+    int hiz_valid;
+};
+
+// per-pixel id of the nearest triangle, (draw << RASTERIZER_VISIBILITY_TRIANGLE_BITS) | triangle within the draw
+#define RASTERIZER_VISIBILITY_TRIANGLE_BITS (20)
+#define RASTERIZER_VISIBILITY_EMPTY (0xFFFFFFFFu)
+
+struct rasterizer_visibility_triangle;
+
+// caller-owned, same size as the depth buffer it is used with. while bound, triangles only write depth and their id,
+// and rasterizer_resolve_visibility shades each covered pixel once, with the triangle which ended up in front.
+struct rasterizer_visibility_buffer
+{
+    int width;
+    int height;
+    unsigned int *ids;
+
+    // everything rasterized since the last resolve, grown as needed
+    struct rasterizer_visibility_triangle *triangles;
+    unsigned int ntriangles;
+    unsigned int triangles_capacity;
+
+    // index into triangles of each draw's first triangle. a draw only takes an id once it produces a triangle.
+    unsigned int *draw_first_triangle;
+    unsigned int ndraws;
+    unsigned int draws_capacity;
+    int new_draw;
+};
+
+// edge_index values for pixels which have no samples in the edge arrays
+#define RASTERIZER_MSAA_EMPTY (0xFFFFFFFFu)
+#define RASTERIZER_MSAA_UNIFORM (0xFFFFFFFEu)
+
+// caller-owned, 2 or 4 samples per pixel. a pixel stores a single colour and depth while all of its samples agree,
+// only pixels crossed by an edge take a run of samples (colour and depth) from the shared edge arrays.
+struct rasterizer_msaa_buffer
+{
+    int width;
+    int height;
+    int samples;
+
+    // per pixel, colors and depths are only meaningful when edge_index is RASTERIZER_MSAA_UNIFORM
+    unsigned int *colors;
+    rasterizer_depth *depths;
+    unsigned int *edge_index;
+
+    // samples of the edge pixels, grown as needed and emptied by rasterizer_msaa_buffer_clear
+    unsigned int *edge_colors;
+    rasterizer_depth *edge_depths;
+    unsigned int nedge_samples;
+    unsigned int edge_capacity;
+};
+
+// limits of a meshlet, small enough for its vertices to stay in the vertex cache
+#define RASTERIZER_MESHLET_MAX_VERTICES (64)
+#define RASTERIZER_MESHLET_MAX_TRIANGLES (124)
+
+// a cluster of neighbouring triangles of an indexed triangle list, the triangle_count triangles starting at first_index.
+// bounds are in the space the vertices are decoded to, the space the world matrix transforms from.
+struct rasterizer_meshlet
+{
+    unsigned int first_index;
+    unsigned int triangle_count;
+    float center[3];
+    float radius;
+
+    // every triangle's normal lies within the cone around axis, cutoff is the sine of its half angle (1 for none)
+    float cone_axis[3];
+    float cone_cutoff;
+};
+
+// value of revealage where nothing translucent was drawn
+#define RASTERIZER_OIT_CLEAR (0xFFFFu)
+
+// caller-owned weighted blended order-independent transparency (mcguire and bavoil). each pixel sums the colours of its
+// translucent fragments, weighted by alpha and nearness, and multiplies together their transparencies. neither depends
+// on the order the fragments arrive in, and the memory is fixed when the buffer is created.
+struct rasterizer_oit_buffer
+{
+    int width;
+    int height;
+
+    // per pixel weighted red, green and blue sums, and the sum of the weights
+    unsigned int *accum;
+
+    // per pixel product of (1 - alpha), RASTERIZER_OIT_CLEAR is one
+    unsigned short *revealage;
+};
+
+// one run of covered pixels on a row, from x_start up to but not including x_end. colour and depth are those of the
+// first and last pixel, and linear in between. lines have no depth, their z is zero.
+struct rasterizer_span
+{
+    int y;
+    int x_start;
+    int x_end;
+    unsigned int color_start;
+    unsigned int color_end;
+    rasterizer_depth z_start;
+    rasterizer_depth z_end;
+};
+
+// called with the buffered spans when the buffer is full, and by rasterizer_span_buffer_flush
+typedef void(*rs_spans_fn)(void *userdata, const struct rasterizer_span *spans, size_t count);
+
+// caller-owned span output, see rasterizer_set_span_buffer. spans arrive in draw order, one per covered row of a
+// triangle, so the coverage is run-length encoded and its size follows the edges rather than the area.
+struct rasterizer_span_buffer
+{
+    struct rasterizer_span *spans;
+    size_t capacity;
+    size_t count;
+
+    // optional, without it spans which don't fit are counted in dropped instead
+    rs_spans_fn flush;
+    void *userdata;
+    size_t dropped;
+};
+
+struct job_pool;
+
+// a render context. contexts share nothing mutable, so any number of them can render concurrently, one thread per
+// context at a time. the context owns only its scratch memory (released by rasterizer_destroy), everything it points
+// to (callback userdata, depth/visibility/msaa buffers, the job pool) belongs to the caller and must outlive its use.
+// a job pool is thread safe and may be shared between contexts, the buffers may not.
 struct rasterizer_state
 {
+    // read freely, but write through the rasterizer_set_* functions so the derived state is invalidated
     mat4x4 world_matrix;
     mat4x4 view_matrix;
     mat4x4 projection_matrix;
+
+    // viewport the draw in progress renders into, one of viewports[]
     struct viewport_state viewport;
+    struct viewport_state viewports[RASTERIZER_MAX_VIEWPORTS];
+    unsigned int nviewports;
+    unsigned int viewport_mask;
+    unsigned int current_viewport;
+
+    // see rasterizer_set_scissor
+    int has_scissor;
+    struct rasterizer_rect scissor;
 
     struct rasterizer_functions functions;
+
+    // RASTERIZER_FLAG_*, see rasterizer_set_flags
+    unsigned int flags;
+
+    // optional, see rasterizer_set_depth_buffer
+    struct rasterizer_depth_buffer *depth_buffer;
+
+    // optional, only used together with a depth buffer, see rasterizer_set_visibility_buffer
+    struct rasterizer_visibility_buffer *visibility_buffer;
+
+    // optional, see rasterizer_set_msaa_buffer
+    struct rasterizer_msaa_buffer *msaa_buffer;
+
+    // optional, see rasterizer_set_oit_buffer
+    struct rasterizer_oit_buffer *oit_buffer;
+
+    // optional, see rasterizer_set_span_buffer
+    struct rasterizer_span_buffer *span_buffer;
+
+    // optional, see rasterizer_set_job_pool
+    struct job_pool *job_pool;
+
+    // applies to every draw until changed, see rasterizer_set_bounds
+    int has_bounds;
+    struct rasterizer_bounds bounds;
+
+    unsigned int dirty;
+    struct rasterizer_derived_state derived;
+
+    // grown on demand by draws which need temporary memory, kept for the next one
+    void *scratch;
+    size_t scratch_size;
 };
 
 typedef struct
@@ -38,14 +331,141 @@ typedef struct
     unsigned int color;
 } rasterizer_vertex;
 
+// positions quantized to 16 bits, decoded as (x, y, z) * scale + bias before the world matrix is applied
+typedef struct
+{
+    short x, y, z;
+    unsigned short reserved;
+    unsigned int color;
+} rasterizer_packed_vertex;
+
 #define MAKE_COLOR_R8G8B8_UNORM(r, g, b) ((unsigned int)0xFF000000 | ((unsigned int)(b) << 16) | ((unsigned int)(g) << 8) | ((unsigned int)(r)) )
 #define MAKE_COLOR_R8G8B8A8_UNORM(r, g, b, a) ( ((unsigned int)(a) << 24) | ((unsigned int)(b) << 16) | ((unsigned int)(g) << 8) | ((unsigned int)(r)) )
 
+// identity matrices, empty viewport, colour interpolation on
+void rasterizer_init(struct rasterizer_state *rs, const struct rasterizer_functions *functions);
+
+// frees the context's scratch memory, the context can be initialized again afterwards
+void rasterizer_destroy(struct rasterizer_state *rs);
+
+void rasterizer_set_flags(struct rasterizer_state *rs, unsigned int flags);
+
+void rasterizer_set_world_matrix(struct rasterizer_state *rs, const mat4x4 *world_matrix);
+void rasterizer_set_view_matrix(struct rasterizer_state *rs, const mat4x4 *view_matrix);
+void rasterizer_set_projection_matrix(struct rasterizer_state *rs, const mat4x4 *projection_matrix);
+void rasterizer_set_viewport(struct rasterizer_state *rs, const struct viewport_state *viewport);
+
+// every draw renders into each viewport selected by the mask, for split screens or grids of thumbnails. the matrices
+// are shared, only the mapping to the screen and the clipping differ. rasterizer_set_viewport is the one-element case.
+void rasterizer_set_viewports(struct rasterizer_state *rs, const struct viewport_state *viewports, unsigned int count);
+
+// bit i enables viewports[i], all of them by default
+void rasterizer_set_viewport_mask(struct rasterizer_state *rs, unsigned int mask);
+
+// screen-space rectangle intersected with every viewport, or NULL for none. pixels outside it are never visited.
+void rasterizer_set_scissor(struct rasterizer_state *rs, const struct rasterizer_rect *scissor);
+
+// bounds of the vertices passed to the following draws, or NULL for none. draws whose bounds lie outside the
+// frustum are dropped before any vertex is transformed, instanced draws test the bounds once per instance.
+void rasterizer_set_bounds(struct rasterizer_state *rs, const struct rasterizer_bounds *bounds);
+
+// returns non-zero if the bounds are at least partially on the inside of all the planes
+int rasterizer_bounds_in_frustum(const struct rasterizer_bounds *bounds, const vec4 planes[RASTERIZER_FRUSTUM_PLANE_COUNT]);
+
+// returns 0 on success, -1 if memory could not be allocated
+int rasterizer_depth_buffer_init(struct rasterizer_depth_buffer *db, int width, int height);
+void rasterizer_depth_buffer_destroy(struct rasterizer_depth_buffer *db);
+void rasterizer_depth_buffer_clear(struct rasterizer_depth_buffer *db);
+
+// NULL disables depth testing
+void rasterizer_set_depth_buffer(struct rasterizer_state *rs, struct rasterizer_depth_buffer *db);
+
+// builds the hi-z pyramid from the current depth, typically after drawing the occluders. until the depth buffer is
+// cleared, draws with bounds (and occlusion queries) whose box lies behind the pyramid are skipped entirely.
+void rasterizer_build_hiz(struct rasterizer_state *rs);
+
+// returns non-zero if the bounds, under the current world matrix, may be visible: inside the frustum and not
+// behind the hi-z pyramid. conservative, boxes crossing the near plane always count as visible.
+int rasterizer_occlusion_query(struct rasterizer_state *rs, const struct rasterizer_bounds *bounds);
+
+// returns 0 on success, -1 if memory could not be allocated
+int rasterizer_visibility_buffer_init(struct rasterizer_visibility_buffer *vb, int width, int height);
+void rasterizer_visibility_buffer_destroy(struct rasterizer_visibility_buffer *vb);
+
+// NULL returns to shading every pixel as it is rasterized. lines are never deferred, so draw them after resolving.
+void rasterizer_set_visibility_buffer(struct rasterizer_state *rs, struct rasterizer_visibility_buffer *vb);
+
+// shades the visible pixels, tile by tile, and empties the buffer. this also happens on its own if the draw ids run out.
+void rasterizer_resolve_visibility(struct rasterizer_state *rs);
+
+// samples must be 2 or 4. returns 0 on success, -1 if memory could not be allocated or samples is unsupported.
+int rasterizer_msaa_buffer_init(struct rasterizer_msaa_buffer *mb, int width, int height, int samples);
+void rasterizer_msaa_buffer_destroy(struct rasterizer_msaa_buffer *mb);
+void rasterizer_msaa_buffer_clear(struct rasterizer_msaa_buffer *mb);
+
+// while bound, triangles are rasterized into the multisample buffer, shading once per pixel and testing depth per sample
+// (if a depth buffer is bound, as the enable switch). the visibility buffer and hi-z tiles are not used, lines are not antialiased.
+void rasterizer_set_msaa_buffer(struct rasterizer_state *rs, struct rasterizer_msaa_buffer *mb);
+
+// averages the samples of every covered pixel and writes them out with set_pixel. uncovered samples count as zero.
+void rasterizer_resolve_msaa(struct rasterizer_state *rs);
+
+// returns 0 on success, -1 if memory could not be allocated
+int rasterizer_oit_buffer_init(struct rasterizer_oit_buffer *ob, int width, int height);
+void rasterizer_oit_buffer_destroy(struct rasterizer_oit_buffer *ob);
+void rasterizer_oit_buffer_clear(struct rasterizer_oit_buffer *ob);
+
+// while bound, triangles are translucent and can be drawn in any order: their pixels are accumulated into the buffer,
+// depth tested against the depth buffer (if one is bound) but never written to it. the visibility and msaa buffers are
+// bypassed, lines are drawn as usual.
+void rasterizer_set_oit_buffer(struct rasterizer_state *rs, struct rasterizer_oit_buffer *ob);
+
+// composites the accumulated pixels over what get_pixel returns, with set_pixel. resolve the opaque geometry first.
+void rasterizer_resolve_oit(struct rasterizer_state *rs);
+
+// spans are written to the caller's array of capacity entries, flush may be NULL
+void rasterizer_span_buffer_init(struct rasterizer_span_buffer *sb, struct rasterizer_span *spans, size_t capacity, rs_spans_fn flush, void *userdata);
+
+// passes the buffered spans to the flush callback, if there is one, and empties the buffer and its dropped count
+void rasterizer_span_buffer_flush(struct rasterizer_span_buffer *sb);
+
+// while bound, triangles and lines write spans instead of calling set_pixel, NULL returns to pixels. this is coverage only,
+// the depth, visibility and msaa buffers are neither tested nor written.
+void rasterizer_set_span_buffer(struct rasterizer_state *rs, struct rasterizer_span_buffer *sb);
+
+// large non-indexed draws transform, and cull, their vertices in chunks on the pool, then rasterize in submission order.
+// NULL keeps everything on the calling thread.
+void rasterizer_set_job_pool(struct rasterizer_state *rs, struct job_pool *pool);
+
+// brings the derived state up to date if anything changed, draws do this themselves
+const struct rasterizer_derived_state *rasterizer_get_derived_state(struct rasterizer_state *rs);
+
 void rasterizer_draw_screen_line(const struct rasterizer_state *rs, float x1, float y1, unsigned int color1, float x2, float y2, unsigned int color2);
 
-void rasterizer_draw_line(const struct rasterizer_state *rs, const rasterizer_vertex verts[2]);
-void rasterizer_draw_line_list(const struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts);
+void rasterizer_draw_line(struct rasterizer_state *rs, const rasterizer_vertex verts[2]);
+void rasterizer_draw_line_list(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts);
+
+// index value which ends the current strip/fan (or partial list triangle) in indexed draws
+#define RASTERIZER_PRIMITIVE_RESTART_INDEX (0xFFFFFFFFu)
+
+void rasterizer_draw_triangle(struct rasterizer_state *rs, const rasterizer_vertex verts[3]);
+void rasterizer_draw_triangle_list(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts);
+void rasterizer_draw_triangle_strip(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts);
+void rasterizer_draw_triangle_fan(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts);
+
+void rasterizer_draw_indexed_triangle_list(struct rasterizer_state *rs, const rasterizer_vertex *verts, const unsigned int *indices, size_t nindices);
+void rasterizer_draw_indexed_triangle_strip(struct rasterizer_state *rs, const rasterizer_vertex *verts, const unsigned int *indices, size_t nindices);
+void rasterizer_draw_indexed_triangle_fan(struct rasterizer_state *rs, const rasterizer_vertex *verts, const unsigned int *indices, size_t nindices);
+
+void rasterizer_draw_packed_indexed_triangle_list(struct rasterizer_state *rs, const rasterizer_packed_vertex *verts, const float scale[3], const float bias[3], const unsigned int *indices, size_t nindices);
 
-void rasterizer_draw_triangle(const struct rasterizer_state *rs, const rasterizer_vertex verts[3]);
-void rasterizer_draw_triangle_list(const struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts);
+// the same, one meshlet at a time. meshlets outside the frustum, facing away from the camera, or behind the hi-z
+// pyramid are skipped before any of their vertices are transformed.
+void rasterizer_draw_packed_meshlets(struct rasterizer_state *rs, const rasterizer_packed_vertex *verts, const float scale[3], const float bias[3], const unsigned int *indices, const struct rasterizer_meshlet *meshlets, size_t nmeshlets);
 
+// draws the same vertices once per instance, with instance_matrices[i] in place of the world matrix.
+// instance_colors is optional, when given each instance's vertex colours are modulated by its entry.
+void rasterizer_draw_line_list_instanced(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances);
+void rasterizer_draw_triangle_list_instanced(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances);
+void rasterizer_draw_indexed_triangle_list_instanced(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, const unsigned int *indices, size_t nindices, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances);
+void rasterizer_draw_indexed_triangle_strip_instanced(struct rasterizer_state *rs, const rasterizer_vertex *verts, size_t nverts, const unsigned int *indices, size_t nindices, const mat4x4 *instance_matrices, const unsigned int *instance_colors, size_t ninstances);
@@ -0,0 +1,241 @@
+#include "scene.h"
+#include <math.h>
+#include <string.h>
+
+// objects per leaf, below this a node is not split any further
+#define SCENE_LEAF_SIZE (4)
+
+// traversal stack, median splits keep the tree depth at log2(objects)
+#define SCENE_STACK_SIZE (64)
+
+#define SCENE_ALL_PLANES ((1u << RASTERIZER_FRUSTUM_PLANE_COUNT) - 1)
+
+void scene_init(struct scene *scene)
+{
+    memset(scene, 0, sizeof(*scene));
+}
+
+void scene_destroy(struct scene *scene)
+{
+    free(scene->objects);
+    free(scene->nodes);
+    free(scene->object_order);
+    memset(scene, 0, sizeof(*scene));
+}
+
+unsigned int scene_add(struct scene *scene, const struct rasterizer_bounds *world_bounds, void *userdata)
+{
+    if (scene->nobjects == scene->objects_capacity)
+    {
+        unsigned int capacity = (scene->objects_capacity == 0) ? 64 : (scene->objects_capacity * 2);
+        struct scene_object *objects = (struct scene_object *)realloc(scene->objects, sizeof(struct scene_object) * capacity);
+        if (objects == NULL)
+            return SCENE_NO_OBJECT;
+
+        scene->objects = objects;
+        scene->objects_capacity = capacity;
+    }
+
+    struct scene_object *object = &scene->objects[scene->nobjects];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = (world_bounds->type == RASTERIZER_BOUNDS_SPHERE) ? world_bounds->radius : world_bounds->extents[axis];
+        object->min[axis] = world_bounds->center[axis] - extent;
+        object->max[axis] = world_bounds->center[axis] + extent;
+    }
+
+    object->userdata = userdata;
+    return scene->nobjects++;
+}
+
+// twice the centre, only ever compared against other centroids
+static float scene_centroid(const struct scene *scene, unsigned int object, int axis)
+{
+    return scene->objects[object].min[axis] + scene->objects[object].max[axis];
+}
+
+// partial quicksort, leaves the median centroid at order[count / 2] with smaller ones before and larger ones after
+static void scene_select_median(const struct scene *scene, unsigned int *order, int count, int axis)
+{
+    int k = count / 2;
+    int lo = 0;
+    int hi = count - 1;
+    while (lo < hi)
+    {
+        float pivot = scene_centroid(scene, order[(lo + hi) / 2], axis);
+        int i = lo;
+        int j = hi;
+        while (i <= j)
+        {
+            while (scene_centroid(scene, order[i], axis) < pivot)
+                i++;
+            while (scene_centroid(scene, order[j], axis) > pivot)
+                j--;
+
+            if (i <= j)
+            {
+                unsigned int temp = order[i];
+                order[i++] = order[j];
+                order[j--] = temp;
+            }
+        }
+
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+}
+
+static void scene_build_node(struct scene *scene, unsigned int node_index, unsigned int first, unsigned int count)
+{
+    struct scene_node *node = &scene->nodes[node_index];
+    float centroid_min[3], centroid_max[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        node->min[axis] = centroid_min[axis] = 3.402823466e+38f;
+        node->max[axis] = centroid_max[axis] = -3.402823466e+38f;
+    }
+
+    for (unsigned int i = first; i < (first + count); i++)
+    {
+        const struct scene_object *object = &scene->objects[scene->object_order[i]];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float centroid = object->min[axis] + object->max[axis];
+            node->min[axis] = (object->min[axis] < node->min[axis]) ? object->min[axis] : node->min[axis];
+            node->max[axis] = (object->max[axis] > node->max[axis]) ? object->max[axis] : node->max[axis];
+            centroid_min[axis] = (centroid < centroid_min[axis]) ? centroid : centroid_min[axis];
+            centroid_max[axis] = (centroid > centroid_max[axis]) ? centroid : centroid_max[axis];
+        }
+    }
+
+    node->first = first;
+    node->count = count;
+    node->left = 0;
+    if (count <= SCENE_LEAF_SIZE)
+        return;
+
+    // split the longest axis of the centroids at the median, so both halves get the same number of objects
+    int axis = 0;
+    for (int i = 1; i < 3; i++)
+    {
+        if ((centroid_max[i] - centroid_min[i]) > (centroid_max[axis] - centroid_min[axis]))
+            axis = i;
+    }
+
+    scene_select_median(scene, scene->object_order + first, (int)count, axis);
+
+    unsigned int left = scene->nnodes;
+    unsigned int half = count / 2;
+    scene->nnodes += 2;
+    node->left = left;
+    scene_build_node(scene, left, first, half);
+    scene_build_node(scene, left + 1, first + half, count - half);
+}
+
+int scene_build(struct scene *scene)
+{
+    free(scene->nodes);
+    free(scene->object_order);
+    scene->nodes = NULL;
+    scene->object_order = NULL;
+    scene->nnodes = 0;
+    if (scene->nobjects == 0)
+        return 0;
+
+    // a binary tree with at least one object per leaf never has more than 2n - 1 nodes
+    scene->nodes = (struct scene_node *)malloc(sizeof(struct scene_node) * (size_t)scene->nobjects * 2);
+    scene->object_order = (unsigned int *)malloc(sizeof(unsigned int) * scene->nobjects);
+    if (scene->nodes == NULL || scene->object_order == NULL)
+    {
+        free(scene->nodes);
+        free(scene->object_order);
+        scene->nodes = NULL;
+        scene->object_order = NULL;
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < scene->nobjects; i++)
+        scene->object_order[i] = i;
+
+    scene->nnodes = 1;
+    scene_build_node(scene, 0, 0, scene->nobjects);
+    return 0;
+}
+
+// returns zero if the box is outside any plane in mask, and clears planes it is entirely inside from mask
+static int scene_test_box(const float min[3], const float max[3], const vec4 *planes, unsigned int *mask)
+{
+    float center[3], extents[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        center[axis] = (min[axis] + max[axis]) * 0.5f;
+        extents[axis] = (max[axis] - min[axis]) * 0.5f;
+    }
+
+    for (int i = 0; i < RASTERIZER_FRUSTUM_PLANE_COUNT; i++)
+    {
+        unsigned int bit = 1u << i;
+        if (!(*mask & bit))
+            continue;
+
+        const vec4 *plane = &planes[i];
+        float distance = plane->x * center[0] + plane->y * center[1] + plane->z * center[2] + plane->w;
+        float radius = fabsf(plane->x) * extents[0] + fabsf(plane->y) * extents[1] + fabsf(plane->z) * extents[2];
+        if (distance < -radius)
+            return 0;
+        if (distance >= radius)
+            *mask &= ~bit;
+    }
+
+    return 1;
+}
+
+unsigned int scene_cull(const struct scene *scene, const vec4 planes[RASTERIZER_FRUSTUM_PLANE_COUNT], scene_visit_fn visit, void *context)
+{
+    if (scene->nnodes == 0)
+        return 0;
+
+    unsigned int stack_nodes[SCENE_STACK_SIZE];
+    unsigned int stack_masks[SCENE_STACK_SIZE];
+    unsigned int stack_size = 1;
+    unsigned int nvisible = 0;
+    stack_nodes[0] = 0;
+    stack_masks[0] = SCENE_ALL_PLANES;
+
+    while (stack_size > 0)
+    {
+        stack_size--;
+        const struct scene_node *node = &scene->nodes[stack_nodes[stack_size]];
+        unsigned int mask = stack_masks[stack_size];
+        if (!scene_test_box(node->min, node->max, planes, &mask))
+            continue;
+
+        // leaves are small enough to test their objects individually, fully contained nodes need no tests at all
+        if (node->left == 0 || mask == 0)
+        {
+            for (unsigned int i = node->first; i < (node->first + node->count); i++)
+            {
+                unsigned int object = scene->object_order[i];
+                unsigned int object_mask = mask;
+                if (mask != 0 && !scene_test_box(scene->objects[object].min, scene->objects[object].max, planes, &object_mask))
+                    continue;
+
+                visit(context, object, scene->objects[object].userdata);
+                nvisible++;
+            }
+
+            continue;
+        }
+
+        stack_nodes[stack_size] = node->left + 1;
+        stack_masks[stack_size++] = mask;
+        stack_nodes[stack_size] = node->left;
+        stack_masks[stack_size++] = mask;
+    }
+
+    return nvisible;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "rasterizer.h"
+
+// flat list of objects with world-space bounds, and a bounding volume hierarchy over them for frustum culling.
+// objects are added, then the hierarchy is built once, and culled as many times as needed.
+struct scene_object
+{
+    float min[3];
+    float max[3];
+    void *userdata;
+};
+
+// each node covers the contiguous range [first, first + count) of object_order. interior nodes have
+// their children at left and left + 1, leaves have left == 0 (the root is never anyone's child).
+struct scene_node
+{
+    float min[3];
+    float max[3];
+    unsigned int left;
+    unsigned int first;
+    unsigned int count;
+};
+
+struct scene
+{
+    struct scene_object *objects;
+    unsigned int nobjects;
+    unsigned int objects_capacity;
+
+    struct scene_node *nodes;
+    unsigned int nnodes;
+    unsigned int *object_order;
+};
+
+// called for each object which may be visible
+typedef void(*scene_visit_fn)(void *context, unsigned int object, void *userdata);
+
+void scene_init(struct scene *scene);
+void scene_destroy(struct scene *scene);
+
+// returned by scene_add when the object list could not grow
+#define SCENE_NO_OBJECT (0xFFFFFFFFu)
+
+// returns the object's index. the hierarchy is out of date until scene_build is called again.
+unsigned int scene_add(struct scene *scene, const struct rasterizer_bounds *world_bounds, void *userdata);
+
+// returns 0 on success, -1 if memory could not be allocated, which leaves the scene without a hierarchy (nothing is
+// visited until it is built again).
+int scene_build(struct scene *scene);
+
+// visits every object whose bounds intersect the planes (usually rasterizer_derived_state.world_planes),
+// returns the number visited. subtrees entirely inside the frustum are visited without further tests.
+unsigned int scene_cull(const struct scene *scene, const vec4 planes[RASTERIZER_FRUSTUM_PLANE_COUNT], scene_visit_fn visit, void *context);
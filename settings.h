@@ -3,9 +3,38 @@
 // enable colours on ncurses
 #define USE_NCURSES_COLOR 1
 
+// ncurses dithering down to the colour pairs: 0 = none, 1 = ordered (bayer), 2 = floyd-steinberg ('d' cycles)
+#define NCURSES_DITHER_MODE 1
+
+// ansi terminal backend: pack 2x4 braille dots per cell instead of 1x2 half blocks ('m' toggles)
+#define ANSI_SUBCELL_BRAILLE 1
+
+// ansi terminal backend: framebuffers in flight, written out on a separate thread while the next frame renders (2 or 3, 0 = present on the render thread)
+#define PRESENT_BUFFERS 2
+
+// worker threads for transforming large draws, in addition to the render thread (0 = single threaded)
+#define WORKER_THREADS 3
+
 // enable-disable colour interplolation
 #define COLOR_INTERPOLATION 1
 
+// rasterize triangle ids first and shade each visible pixel once, instead of shading every covered pixel
+#define VISIBILITY_BUFFER 1
+
+// multisample anti-aliasing of triangle edges: 0 = off, 2 or 4 samples per pixel (takes over from the visibility buffer)
+#define MSAA_SAMPLES 0
+
+// dynamic resolution: render time to aim for per frame in milliseconds, frames render below the screen's resolution
+// and are upscaled when they take longer (0 = off, always the screen's resolution)
+#define DYNAMIC_RESOLUTION_BUDGET_MS (0)
+
+// upscale filter for dynamic resolution: 0 = nearest, 1 = bilinear
+#define DYNAMIC_RESOLUTION_FILTER 1
+
+// memory for the resident chunks of a stream file given on the command line, in kilobytes. chunks stream in from disk
+// as they come into view, and the least recently drawn are evicted to make room
+#define STREAMING_BUDGET_KB (4096)
+
 // use win32 window instead of console
 #define WIN32_USE_WINDOW 1
 
@@ -0,0 +1,7 @@
+#pragma once
+
+// sse2 is baseline on x86-64, and on 32-bit msvc when /arch:SSE2 is set
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define USE_SSE2 1
+    #include <emmintrin.h>
+#endif
@@ -0,0 +1,500 @@
+#include "stream.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+static size_t stream_chunk_size(const struct stream_chunk *chunk)
+{
+    return sizeof(rasterizer_packed_vertex) * (size_t)chunk->vertex_count + sizeof(unsigned int) * (size_t)chunk->index_count;
+}
+
+static void stream_decode_position(float p[3], const rasterizer_packed_vertex *vertex, const float scale[3], const float bias[3])
+{
+    p[0] = (float)vertex->x * scale[0] + bias[0];
+    p[1] = (float)vertex->y * scale[1] + bias[1];
+    p[2] = (float)vertex->z * scale[2] + bias[2];
+}
+
+// sphere around the box of the chunk's decoded positions, the same fit as meshlets get
+static void stream_chunk_bounds(struct stream_chunk *chunk, const rasterizer_packed_vertex *verts, const float scale[3], const float bias[3])
+{
+    float bounds_min[3] = { 3.402823466e+38f, 3.402823466e+38f, 3.402823466e+38f };
+    float bounds_max[3] = { -3.402823466e+38f, -3.402823466e+38f, -3.402823466e+38f };
+    for (unsigned int v = 0; v < chunk->vertex_count; v++)
+    {
+        float p[3];
+        stream_decode_position(p, &verts[v], scale, bias);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bounds_min[axis] = fminf(bounds_min[axis], p[axis]);
+            bounds_max[axis] = fmaxf(bounds_max[axis], p[axis]);
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+        chunk->center[axis] = (bounds_min[axis] + bounds_max[axis]) * 0.5f;
+
+    float radius_sq = 0.0f;
+    for (unsigned int v = 0; v < chunk->vertex_count; v++)
+    {
+        float p[3];
+        stream_decode_position(p, &verts[v], scale, bias);
+        float dx = p[0] - chunk->center[0], dy = p[1] - chunk->center[1], dz = p[2] - chunk->center[2];
+        radius_sq = fmaxf(radius_sq, dx * dx + dy * dy + dz * dz);
+    }
+
+    chunk->radius = sqrtf(radius_sq);
+}
+
+int stream_write_mesh(const struct mesh *mesh, const char *filename, unsigned int chunk_triangles)
+{
+    unsigned int ntris = mesh->nindices / 3;
+    if (chunk_triangles == 0 || ntris == 0)
+        return -1;
+
+    // first triangle of each chunk. meshlets are contiguous and in order, so chunks end where they do, unless a single
+    // meshlet is over the size on its own.
+    unsigned int *starts = (unsigned int *)malloc(sizeof(unsigned int) * ((size_t)ntris + 1));
+    if (starts == NULL)
+        return -1;
+
+    unsigned int nchunks = 0;
+    unsigned int first = 0;
+    if (mesh->nmeshlets > 0)
+    {
+        for (unsigned int i = 0; i < mesh->nmeshlets; i++)
+        {
+            unsigned int start = mesh->meshlets[i].first_index / 3;
+            if (start + mesh->meshlets[i].triangle_count - first > chunk_triangles && start > first)
+            {
+                starts[nchunks++] = first;
+                first = start;
+            }
+        }
+
+        starts[nchunks++] = first;
+    }
+    else
+    {
+        for (first = 0; first < ntris; first += chunk_triangles)
+            starts[nchunks++] = first;
+    }
+
+    starts[nchunks] = ntris;
+
+    unsigned int max_triangles = 0;
+    for (unsigned int i = 0; i < nchunks; i++)
+        max_triangles = (starts[i + 1] - starts[i] > max_triangles) ? (starts[i + 1] - starts[i]) : max_triangles;
+
+    struct stream_chunk *chunks = (struct stream_chunk *)calloc(nchunks, sizeof(struct stream_chunk));
+    unsigned int *remap = (unsigned int *)malloc(sizeof(unsigned int) * (mesh->nverts > 0 ? mesh->nverts : 1));
+    rasterizer_packed_vertex *verts = (rasterizer_packed_vertex *)malloc(sizeof(rasterizer_packed_vertex) * (size_t)max_triangles * 3);
+    unsigned int *indices = (unsigned int *)malloc(sizeof(unsigned int) * (size_t)max_triangles * 3);
+    FILE *fp = fopen(filename, "wb");
+
+    struct stream_file_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = STREAM_FILE_MAGIC;
+    header.version = STREAM_FILE_VERSION;
+    header.chunk_count = nchunks;
+    header.chunk_offset = sizeof(header);
+    memcpy(header.scale, mesh->scale, sizeof(header.scale));
+    memcpy(header.bias, mesh->bias, sizeof(header.bias));
+
+    // the table is written again once the chunks have been, with their offsets and bounds filled in
+    int result = 0;
+    if (chunks == NULL || remap == NULL || verts == NULL || indices == NULL || fp == NULL ||
+        fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(chunks, sizeof(struct stream_chunk), nchunks, fp) != nchunks)
+    {
+        result = -1;
+    }
+
+    unsigned long long offset = sizeof(header) + sizeof(struct stream_chunk) * (unsigned long long)nchunks;
+    if (remap != NULL)
+        memset(remap, 0xFF, sizeof(unsigned int) * mesh->nverts);
+    for (unsigned int i = 0; i < nchunks && result == 0; i++)
+    {
+        // vertices are renumbered in order of first use, as the converter orders the whole mesh
+        struct stream_chunk *chunk = &chunks[i];
+        const unsigned int *mesh_indices = mesh->indices + (size_t)starts[i] * 3;
+        chunk->index_count = (starts[i + 1] - starts[i]) * 3;
+        for (unsigned int j = 0; j < chunk->index_count; j++)
+        {
+            unsigned int v = mesh_indices[j];
+            if (remap[v] == 0xFFFFFFFFu)
+            {
+                remap[v] = chunk->vertex_count;
+                verts[chunk->vertex_count++] = mesh->verts[v];
+            }
+
+            indices[j] = remap[v];
+        }
+
+        for (unsigned int j = 0; j < chunk->index_count; j++)
+            remap[mesh_indices[j]] = 0xFFFFFFFFu;
+
+        stream_chunk_bounds(chunk, verts, mesh->scale, mesh->bias);
+        chunk->offset = offset;
+        offset += stream_chunk_size(chunk);
+        header.max_chunk_size = ((unsigned int)stream_chunk_size(chunk) > header.max_chunk_size) ? (unsigned int)stream_chunk_size(chunk) : header.max_chunk_size;
+        if (fwrite(verts, sizeof(rasterizer_packed_vertex), chunk->vertex_count, fp) != chunk->vertex_count ||
+            fwrite(indices, sizeof(unsigned int), chunk->index_count, fp) != chunk->index_count)
+        {
+            result = -1;
+        }
+    }
+
+    if (result == 0 &&
+        (fseek(fp, 0, SEEK_SET) != 0 ||
+         fwrite(&header, sizeof(header), 1, fp) != 1 ||
+         fwrite(chunks, sizeof(struct stream_chunk), nchunks, fp) != nchunks))
+    {
+        result = -1;
+    }
+
+    if (fp != NULL && fclose(fp) != 0)
+        result = -1;
+
+    free(indices);
+    free(verts);
+    free(remap);
+    free(chunks);
+    free(starts);
+    return result;
+}
+
+// reads all of [offset, offset + size) or fails, without touching a shared file position
+static int stream_read(const struct stream *s, unsigned long long offset, void *dst, size_t size)
+{
+#if defined(_WIN32)
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+    DWORD count;
+    return (ReadFile(s->file, dst, (DWORD)size, &count, &overlapped) && count == (DWORD)size) ? 0 : -1;
+#else
+    unsigned char *p = (unsigned char *)dst;
+    while (size > 0)
+    {
+        ssize_t count = pread(s->file, p, size, (off_t)offset);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return -1;
+
+        p += count;
+        size -= (size_t)count;
+        offset += (unsigned long long)count;
+    }
+
+    return 0;
+#endif
+}
+
+// chunks are drawn straight from their slot, so an index past the chunk's vertices would read outside it
+static int stream_check_indices(const struct stream_chunk *chunk, const unsigned char *data)
+{
+    const unsigned int *indices = (const unsigned int *)(data + sizeof(rasterizer_packed_vertex) * chunk->vertex_count);
+    for (unsigned int i = 0; i < chunk->index_count; i++)
+    {
+        if (indices[i] >= chunk->vertex_count)
+            return -1;
+    }
+
+    return 0;
+}
+
+// a free slot, or else the least recently drawn one which the current frame has not drawn. -1 if every slot is
+// loading or holds something the current frame draws, then the remaining requests wait for the view to change.
+static int stream_find_slot(const struct stream *s)
+{
+    int best = -1;
+    for (unsigned int i = 0; i < s->nslots; i++)
+    {
+        const struct stream_slot *slot = &s->slots[i];
+        if (slot->state == STREAM_SLOT_FREE)
+            return (int)i;
+
+        // unsigned differences keep the comparison correct when the frame counter wraps
+        if (slot->state == STREAM_SLOT_RESIDENT && slot->last_used != s->frame &&
+            (best < 0 || (int)(slot->last_used - s->slots[best].last_used) < 0))
+        {
+            best = (int)i;
+        }
+    }
+
+    return best;
+}
+
+static void stream_thread(void *arg)
+{
+    struct stream *s = (struct stream *)arg;
+
+    mutex_lock(&s->lock);
+    for (;;)
+    {
+        while (s->next_request == s->nrequests && !s->quit)
+            condition_wait(&s->changed, &s->lock);
+        if (s->quit)
+            break;
+
+        unsigned int chunk = s->requests[s->next_request++];
+        if (s->chunk_slots[chunk] != STREAM_NOT_RESIDENT)
+            continue;
+
+        int index = stream_find_slot(s);
+        if (index < 0)
+        {
+            s->next_request = s->nrequests;
+            continue;
+        }
+
+        struct stream_slot *slot = &s->slots[index];
+        if (slot->state == STREAM_SLOT_RESIDENT)
+        {
+            s->chunk_slots[slot->chunk] = STREAM_NOT_RESIDENT;
+            s->evictions++;
+        }
+
+        // loading slots are neither drawn nor evicted, so the data can be written without the lock
+        slot->chunk = chunk;
+        slot->state = STREAM_SLOT_LOADING;
+        s->chunk_slots[chunk] = index;
+        mutex_unlock(&s->lock);
+
+        int result = stream_read(s, s->chunks[chunk].offset, slot->data, stream_chunk_size(&s->chunks[chunk]));
+        if (result == 0)
+            result = stream_check_indices(&s->chunks[chunk], slot->data);
+
+        mutex_lock(&s->lock);
+        if (result == 0)
+        {
+            slot->state = STREAM_SLOT_RESIDENT;
+            slot->last_used = s->frame;
+            s->loads++;
+        }
+        else
+        {
+            // unreadable or corrupt, either way it is never requested again
+            slot->state = STREAM_SLOT_FREE;
+            s->chunk_slots[chunk] = STREAM_UNREADABLE;
+        }
+    }
+
+    mutex_unlock(&s->lock);
+}
+
+static void stream_free(struct stream *s)
+{
+#if defined(_WIN32)
+    if (s->file != INVALID_HANDLE_VALUE)
+        CloseHandle(s->file);
+#else
+    if (s->file >= 0)
+        close(s->file);
+#endif
+
+    free(s->draw_list);
+    free(s->candidate_distances);
+    free(s->candidates);
+    free(s->requests);
+    free(s->memory);
+    free(s->slots);
+    free(s->chunk_slots);
+    free(s->chunks);
+    memset(s, 0, sizeof(*s));
+}
+
+int stream_open(struct stream *s, const char *filename, size_t budget)
+{
+    memset(s, 0, sizeof(*s));
+#if defined(_WIN32)
+    s->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+#else
+    s->file = open(filename, O_RDONLY);
+#endif
+
+    struct stream_file_header header;
+    if (
+#if defined(_WIN32)
+        s->file == INVALID_HANDLE_VALUE ||
+#else
+        s->file < 0 ||
+#endif
+        stream_read(s, 0, &header, sizeof(header)) != 0 ||
+        header.magic != STREAM_FILE_MAGIC || header.version != STREAM_FILE_VERSION ||
+        header.chunk_count == 0 || header.max_chunk_size == 0 || (header.max_chunk_size % 4) != 0 ||
+        budget / header.max_chunk_size == 0)
+    {
+        stream_free(s);
+        return -1;
+    }
+
+    // more slots than chunks would never be used
+    s->nchunks = header.chunk_count;
+    s->slot_size = header.max_chunk_size;
+    s->nslots = (budget / header.max_chunk_size < (size_t)header.chunk_count) ? (unsigned int)(budget / header.max_chunk_size) : header.chunk_count;
+    memcpy(s->scale, header.scale, sizeof(s->scale));
+    memcpy(s->bias, header.bias, sizeof(s->bias));
+
+    s->chunks = (struct stream_chunk *)malloc(sizeof(struct stream_chunk) * (size_t)s->nchunks);
+    s->chunk_slots = (int *)malloc(sizeof(int) * (size_t)s->nchunks);
+    s->slots = (struct stream_slot *)calloc(s->nslots, sizeof(struct stream_slot));
+    s->memory = (unsigned char *)malloc((size_t)s->nslots * s->slot_size);
+    s->requests = (unsigned int *)malloc(sizeof(unsigned int) * s->nslots);
+    s->candidates = (unsigned int *)malloc(sizeof(unsigned int) * s->nslots);
+    s->candidate_distances = (float *)malloc(sizeof(float) * s->nslots);
+    s->draw_list = (unsigned int *)malloc(sizeof(unsigned int) * s->nslots);
+    if (s->chunks == NULL || s->chunk_slots == NULL || s->slots == NULL || s->memory == NULL ||
+        s->requests == NULL || s->candidates == NULL || s->candidate_distances == NULL || s->draw_list == NULL ||
+        stream_read(s, header.chunk_offset, s->chunks, sizeof(struct stream_chunk) * (size_t)s->nchunks) != 0)
+    {
+        stream_free(s);
+        return -1;
+    }
+
+    // a chunk which would not fit a slot is never loaded, the rest of the file is still usable
+    for (unsigned int i = 0; i < s->nchunks; i++)
+    {
+        unsigned long long size = sizeof(rasterizer_packed_vertex) * (unsigned long long)s->chunks[i].vertex_count +
+                                  sizeof(unsigned int) * (unsigned long long)s->chunks[i].index_count;
+        s->chunk_slots[i] = (size <= s->slot_size) ? STREAM_NOT_RESIDENT : STREAM_UNREADABLE;
+    }
+
+    for (unsigned int i = 0; i < s->nslots; i++)
+        s->slots[i].data = s->memory + (size_t)i * s->slot_size;
+
+    mutex_init(&s->lock);
+    condition_init(&s->changed);
+    if (thread_create(&s->thread, stream_thread, s) != 0)
+    {
+        condition_destroy(&s->changed);
+        mutex_destroy(&s->lock);
+        stream_free(s);
+        return -1;
+    }
+
+    return 0;
+}
+
+void stream_close(struct stream *s)
+{
+    if (s->slots == NULL)
+        return;
+
+    // a read in progress finishes first, requests still queued are dropped
+    mutex_lock(&s->lock);
+    s->quit = 1;
+    condition_broadcast(&s->changed);
+    mutex_unlock(&s->lock);
+    thread_join(&s->thread);
+
+    condition_destroy(&s->changed);
+    mutex_destroy(&s->lock);
+    stream_free(s);
+}
+
+void stream_get_bounds(const struct stream *s, struct rasterizer_bounds *bounds)
+{
+    bounds->type = RASTERIZER_BOUNDS_BOX;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bounds->center[axis] = s->bias[axis];
+        bounds->extents[axis] = s->scale[axis] * 32767.0f;
+    }
+
+    bounds->radius = 0.0f;
+}
+
+// distance from the eye to the chunk's sphere, or for orthographic projections its depth along the view direction
+static float stream_chunk_distance(const vec4 *eye, const struct stream_chunk *chunk)
+{
+    if (eye->w == 0.0f)
+        return eye->x * chunk->center[0] + eye->y * chunk->center[1] + eye->z * chunk->center[2] - chunk->radius;
+
+    float dx = chunk->center[0] - eye->x;
+    float dy = chunk->center[1] - eye->y;
+    float dz = chunk->center[2] - eye->z;
+    return sqrtf(dx * dx + dy * dy + dz * dz) - chunk->radius;
+}
+
+void stream_draw(struct stream *s, struct rasterizer_state *rs)
+{
+    const vec4 *eye = &rasterizer_get_derived_state(rs)->object_eye;
+    unsigned int ncandidates = 0;
+    unsigned int ndraws = 0;
+    unsigned int nrequests = 0;
+
+    // choosing the chunks and marking the resident ones as used happen together, so the i/o thread never evicts a
+    // chunk this frame is about to draw
+    mutex_lock(&s->lock);
+    s->frame++;
+    for (unsigned int i = 0; i < s->nchunks; i++)
+    {
+        int index = s->chunk_slots[i];
+        if (index == STREAM_UNREADABLE || (index >= 0 && s->slots[index].state == STREAM_SLOT_LOADING))
+            continue;
+
+        const struct stream_chunk *chunk = &s->chunks[i];
+        struct rasterizer_bounds bounds;
+        bounds.type = RASTERIZER_BOUNDS_SPHERE;
+        memcpy(bounds.center, chunk->center, sizeof(bounds.center));
+        memset(bounds.extents, 0, sizeof(bounds.extents));
+        bounds.radius = chunk->radius;
+        if (!rasterizer_occlusion_query(rs, &bounds))
+            continue;
+
+        // only as many as fit the slots are kept, nearer chunks push farther ones out
+        float distance = stream_chunk_distance(eye, chunk);
+        if (ncandidates == s->nslots && distance >= s->candidate_distances[ncandidates - 1])
+            continue;
+
+        unsigned int j = (ncandidates < s->nslots) ? ncandidates++ : (s->nslots - 1);
+        for (; j > 0 && s->candidate_distances[j - 1] > distance; j--)
+        {
+            s->candidates[j] = s->candidates[j - 1];
+            s->candidate_distances[j] = s->candidate_distances[j - 1];
+        }
+
+        s->candidates[j] = i;
+        s->candidate_distances[j] = distance;
+    }
+
+    for (unsigned int i = 0; i < ncandidates; i++)
+    {
+        int index = s->chunk_slots[s->candidates[i]];
+        if (index >= 0)
+        {
+            s->slots[index].last_used = s->frame;
+            s->draw_list[ndraws++] = (unsigned int)index;
+        }
+        else
+        {
+            s->requests[nrequests++] = s->candidates[i];
+        }
+    }
+
+    s->nrequests = nrequests;
+    s->next_request = 0;
+    if (nrequests > 0)
+        condition_broadcast(&s->changed);
+    mutex_unlock(&s->lock);
+
+    for (unsigned int i = 0; i < ndraws; i++)
+    {
+        const struct stream_slot *slot = &s->slots[s->draw_list[i]];
+        const struct stream_chunk *chunk = &s->chunks[slot->chunk];
+        const rasterizer_packed_vertex *verts = (const rasterizer_packed_vertex *)slot->data;
+        const unsigned int *indices = (const unsigned int *)(slot->data + sizeof(rasterizer_packed_vertex) * chunk->vertex_count);
+        rasterizer_draw_packed_indexed_triangle_list(rs, verts, s->scale, s->bias, indices, chunk->index_count);
+    }
+}
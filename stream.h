@@ -0,0 +1,116 @@
+#pragma once
+#include "mesh.h"
+#include "thread.h"
+
+// out-of-core geometry: a mesh split into independent chunks, each with its own packed vertices and indices, which are
+// read from disk on a dedicated thread as they come into view. chunks live in a fixed number of slots sized from a
+// memory budget, so peak memory does not grow with the file (apart from the chunk table, 32 bytes per chunk), and
+// drawing never waits on the disk: chunks which are not resident yet are requested and skipped until they arrive.
+#define STREAM_FILE_MAGIC (0x54535254)    // 'TRST'
+#define STREAM_FILE_VERSION (1)
+
+// little-endian. header, chunk table, then for each chunk its vertices and then its 32-bit triangle list indices,
+// which index the chunk's own vertices. offsets are 64-bit so files can be larger than the address space.
+struct stream_file_header
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int chunk_count;
+    unsigned int chunk_offset;
+    unsigned int max_chunk_size;
+    unsigned int reserved;
+    float scale[3];
+    float bias[3];
+};
+
+struct stream_chunk
+{
+    unsigned long long offset;
+    unsigned int vertex_count;
+    unsigned int index_count;
+
+    // bounding sphere, in the space the vertices decode to
+    float center[3];
+    float radius;
+};
+
+enum stream_slot_state
+{
+    STREAM_SLOT_FREE,
+    STREAM_SLOT_LOADING,
+    STREAM_SLOT_RESIDENT
+};
+
+struct stream_slot
+{
+    unsigned char *data;
+    unsigned int chunk;
+    enum stream_slot_state state;
+
+    // last frame the chunk was drawn in, slots drawn in the current frame are never evicted
+    unsigned int last_used;
+};
+
+// chunk_slots values for chunks without a slot
+#define STREAM_NOT_RESIDENT (-1)
+#define STREAM_UNREADABLE (-2)
+
+struct stream
+{
+    float scale[3];
+    float bias[3];
+    unsigned int nchunks;
+    struct stream_chunk *chunks;
+
+    // slot of each chunk, or one of the values above. loading chunks have a slot, but are not drawn until resident.
+    int *chunk_slots;
+
+    unsigned int nslots;
+    unsigned int slot_size;
+    struct stream_slot *slots;
+    unsigned char *memory;
+
+    // chunks wanted by the last frame, nearest first. the i/o thread works through them until the next frame
+    // replaces them, so chunks which left the view are never loaded.
+    unsigned int *requests;
+    unsigned int nrequests;
+    unsigned int next_request;
+    unsigned int frame;
+
+    // scratch for the render thread, one entry per slot: the nearest visible chunks, and the resident ones among them
+    unsigned int *candidates;
+    float *candidate_distances;
+    unsigned int *draw_list;
+
+    // counters, for tuning the budget
+    unsigned int loads;
+    unsigned int evictions;
+
+#if defined(_WIN32)
+    HANDLE file;
+#else
+    int file;
+#endif
+    struct thread thread;
+    struct mutex lock;
+    struct condition changed;
+    int quit;
+};
+
+// splits a mesh into chunks of about chunk_triangles triangles (along its meshlets, which keeps them compact) and writes
+// them as a stream file. returns 0 on success, -1 on failure.
+int stream_write_mesh(const struct mesh *mesh, const char *filename, unsigned int chunk_triangles);
+
+// reads the chunk table and starts the i/o thread. budget is the memory for resident chunks in bytes, and has to hold
+// at least the largest chunk. returns 0 on success, -1 if the file is not a stream, the budget is too small, or memory
+// could not be allocated.
+int stream_open(struct stream *s, const char *filename, size_t budget);
+void stream_close(struct stream *s);
+
+// object-space box covering the whole quantization range
+void stream_get_bounds(const struct stream *s, struct rasterizer_bounds *bounds);
+
+// of the chunks which pass rasterizer_occlusion_query under the current world matrix, takes the nearest which fit the
+// budget, draws the resident ones front to back and requests the rest. when the budget is smaller than what is in view,
+// farther chunks make room for nearer ones. one frame per call, from one thread at a time.
+void stream_draw(struct stream *s, struct rasterizer_state *rs);
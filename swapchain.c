@@ -0,0 +1,152 @@
+#include "swapchain.h"
+#include <string.h>
+
+static void swapchain_thread(void *arg)
+{
+    struct swapchain *sc = (struct swapchain *)arg;
+
+    mutex_lock(&sc->lock);
+    for (;;)
+    {
+        // drain the queue before honouring quit, so destroy never drops a submitted frame
+        while (sc->presented == sc->submitted && !sc->quit)
+            condition_wait(&sc->changed, &sc->lock);
+        if (sc->presented == sc->submitted)
+            break;
+
+        const unsigned int *pixels = sc->buffers[sc->presented % (unsigned int)sc->nbuffers];
+        mutex_unlock(&sc->lock);
+
+        sc->present(sc->userdata, pixels, sc->width, sc->height);
+
+        mutex_lock(&sc->lock);
+        sc->presented++;
+        condition_broadcast(&sc->changed);
+    }
+
+    mutex_unlock(&sc->lock);
+}
+
+int swapchain_init(struct swapchain *sc, int width, int height, int nbuffers, swapchain_present_fn present, void *userdata)
+{
+    memset(sc, 0, sizeof(*sc));
+    if (nbuffers < 2 || nbuffers > SWAPCHAIN_MAX_BUFFERS)
+        return -1;
+
+    sc->width = width;
+    sc->height = height;
+    sc->nbuffers = nbuffers;
+    sc->present = present;
+    sc->userdata = userdata;
+    for (int i = 0; i < nbuffers; i++)
+    {
+        sc->buffers[i] = (unsigned int *)malloc(sizeof(unsigned int) * (size_t)width * (size_t)height);
+        if (sc->buffers[i] == NULL)
+        {
+            for (int j = 0; j < i; j++)
+                free(sc->buffers[j]);
+            memset(sc, 0, sizeof(*sc));
+            return -1;
+        }
+
+        memset(sc->buffers[i], 0, sizeof(unsigned int) * (size_t)width * (size_t)height);
+    }
+
+    sc->back_buffer = sc->buffers[0];
+    mutex_init(&sc->lock);
+    condition_init(&sc->changed);
+    if (thread_create(&sc->thread, swapchain_thread, sc) != 0)
+    {
+        condition_destroy(&sc->changed);
+        mutex_destroy(&sc->lock);
+        for (int i = 0; i < nbuffers; i++)
+            free(sc->buffers[i]);
+        memset(sc, 0, sizeof(*sc));
+        return -1;
+    }
+
+    return 0;
+}
+
+void swapchain_destroy(struct swapchain *sc)
+{
+    if (sc->nbuffers == 0)
+        return;
+
+    mutex_lock(&sc->lock);
+    sc->quit = 1;
+    condition_broadcast(&sc->changed);
+    mutex_unlock(&sc->lock);
+    thread_join(&sc->thread);
+
+    condition_destroy(&sc->changed);
+    mutex_destroy(&sc->lock);
+    for (int i = 0; i < sc->nbuffers; i++)
+        free(sc->buffers[i]);
+
+    memset(sc, 0, sizeof(*sc));
+}
+
+unsigned int swapchain_submit(struct swapchain *sc)
+{
+    mutex_lock(&sc->lock);
+    unsigned int fence = sc->submitted++;
+    condition_broadcast(&sc->changed);
+
+    // the next frame reuses the buffer of the frame nbuffers before it, which must have left the present thread
+    while ((sc->submitted - sc->presented) >= (unsigned int)sc->nbuffers)
+        condition_wait(&sc->changed, &sc->lock);
+
+    sc->back_buffer = sc->buffers[sc->submitted % (unsigned int)sc->nbuffers];
+    mutex_unlock(&sc->lock);
+    return fence;
+}
+
+void swapchain_wait(struct swapchain *sc, unsigned int fence)
+{
+    // unsigned differences keep the comparison correct when the counters wrap
+    mutex_lock(&sc->lock);
+    while ((int)(sc->presented - fence) <= 0)
+        condition_wait(&sc->changed, &sc->lock);
+    mutex_unlock(&sc->lock);
+}
+
+static void swapchain_clear(void *userdata)
+{
+    struct swapchain *sc = (struct swapchain *)userdata;
+
+    memset(sc->back_buffer, 0, sizeof(unsigned int) * (size_t)sc->width * (size_t)sc->height);
+}
+
+static void swapchain_set_pixel(void *userdata, int x, int y, unsigned int color)
+{
+    struct swapchain *sc = (struct swapchain *)userdata;
+    if (x < 0 || x >= sc->width || y < 0 || y >= sc->height)
+        return;
+
+    // cleared pixels are zero, drawn pixels always have alpha set
+    sc->back_buffer[y * sc->width + x] = color | 0xFF000000;
+}
+
+static unsigned int swapchain_get_pixel(void *userdata, int x, int y)
+{
+    struct swapchain *sc = (struct swapchain *)userdata;
+    if (x < 0 || x >= sc->width || y < 0 || y >= sc->height)
+        return 0;
+
+    return sc->back_buffer[y * sc->width + x];
+}
+
+static void swapchain_present(void *userdata)
+{
+    swapchain_submit((struct swapchain *)userdata);
+}
+
+void swapchain_get_functions(struct swapchain *sc, struct rasterizer_functions *functions)
+{
+    functions->clear = swapchain_clear;
+    functions->set_pixel = swapchain_set_pixel;
+    functions->present = swapchain_present;
+    functions->get_pixel = swapchain_get_pixel;
+    functions->userdata = sc;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "rasterizer.h"
+#include "thread.h"
+
+// a ring of framebuffers presented in order on a dedicated thread, so frame n is presented while frame n + 1
+// is rasterized. the renderer only blocks when every buffer is still waiting to be presented.
+#define SWAPCHAIN_MAX_BUFFERS (3)
+
+// called on the present thread, pixels stay untouched until it returns
+typedef void(*swapchain_present_fn)(void *userdata, const unsigned int *pixels, int width, int height);
+
+struct swapchain
+{
+    int width;
+    int height;
+    int nbuffers;
+    unsigned int *buffers[SWAPCHAIN_MAX_BUFFERS];
+
+    // fences count frames: frame f renders into buffers[f % nbuffers], and is presented once presented > f
+    unsigned int submitted;
+    unsigned int presented;
+    unsigned int *back_buffer;
+
+    swapchain_present_fn present;
+    void *userdata;
+
+    struct thread thread;
+    struct mutex lock;
+    struct condition changed;
+    int quit;
+};
+
+// nbuffers is 2 or 3. returns 0 on success, -1 if memory could not be allocated or the thread could not be started,
+// in which case the swapchain is left zeroed and swapchain_destroy does nothing.
+int swapchain_init(struct swapchain *sc, int width, int height, int nbuffers, swapchain_present_fn present, void *userdata);
+
+// presents everything already submitted, then stops the thread
+void swapchain_destroy(struct swapchain *sc);
+
+// queues the back buffer for presentation and returns its fence, then waits for the next buffer to be free
+unsigned int swapchain_submit(struct swapchain *sc);
+
+// blocks until the frame with this fence has been presented
+void swapchain_wait(struct swapchain *sc, unsigned int fence);
+
+// clear, set_pixel, get_pixel and present callbacks on the back buffer, present submits it
+void swapchain_get_functions(struct swapchain *sc, struct rasterizer_functions *functions);
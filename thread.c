@@ -0,0 +1,138 @@
+#include "thread.h"
+
+#if defined(_WIN32)
+
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+    struct thread *thread = (struct thread *)param;
+    thread->fn(thread->arg);
+    return 0;
+}
+
+int thread_create(struct thread *thread, thread_fn fn, void *arg)
+{
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    return (thread->handle != NULL) ? 0 : -1;
+}
+
+void thread_join(struct thread *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    thread->handle = NULL;
+}
+
+void mutex_init(struct mutex *mutex)
+{
+    InitializeCriticalSection(&mutex->handle);
+}
+
+void mutex_destroy(struct mutex *mutex)
+{
+    DeleteCriticalSection(&mutex->handle);
+}
+
+void mutex_lock(struct mutex *mutex)
+{
+    EnterCriticalSection(&mutex->handle);
+}
+
+void mutex_unlock(struct mutex *mutex)
+{
+    LeaveCriticalSection(&mutex->handle);
+}
+
+void condition_init(struct condition *condition)
+{
+    InitializeConditionVariable(&condition->handle);
+}
+
+void condition_destroy(struct condition *condition)
+{
+    // win32 condition variables hold no resources
+}
+
+void condition_wait(struct condition *condition, struct mutex *mutex)
+{
+    SleepConditionVariableCS(&condition->handle, &mutex->handle, INFINITE);
+}
+
+void condition_signal(struct condition *condition)
+{
+    WakeConditionVariable(&condition->handle);
+}
+
+void condition_broadcast(struct condition *condition)
+{
+    WakeAllConditionVariable(&condition->handle);
+}
+
+#else
+
+static void *thread_entry(void *param)
+{
+    struct thread *thread = (struct thread *)param;
+    thread->fn(thread->arg);
+    return NULL;
+}
+
+int thread_create(struct thread *thread, thread_fn fn, void *arg)
+{
+    thread->fn = fn;
+    thread->arg = arg;
+    return (pthread_create(&thread->handle, NULL, thread_entry, thread) == 0) ? 0 : -1;
+}
+
+void thread_join(struct thread *thread)
+{
+    pthread_join(thread->handle, NULL);
+}
+
+void mutex_init(struct mutex *mutex)
+{
+    pthread_mutex_init(&mutex->handle, NULL);
+}
+
+void mutex_destroy(struct mutex *mutex)
+{
+    pthread_mutex_destroy(&mutex->handle);
+}
+
+void mutex_lock(struct mutex *mutex)
+{
+    pthread_mutex_lock(&mutex->handle);
+}
+
+void mutex_unlock(struct mutex *mutex)
+{
+    pthread_mutex_unlock(&mutex->handle);
+}
+
+void condition_init(struct condition *condition)
+{
+    pthread_cond_init(&condition->handle, NULL);
+}
+
+void condition_destroy(struct condition *condition)
+{
+    pthread_cond_destroy(&condition->handle);
+}
+
+void condition_wait(struct condition *condition, struct mutex *mutex)
+{
+    pthread_cond_wait(&condition->handle, &mutex->handle);
+}
+
+void condition_signal(struct condition *condition)
+{
+    pthread_cond_signal(&condition->handle);
+}
+
+void condition_broadcast(struct condition *condition)
+{
+    pthread_cond_broadcast(&condition->handle);
+}
+
+#endif
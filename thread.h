@@ -0,0 +1,56 @@
+#pragma once
+
+// just enough threading for the renderer and demos, on win32 or pthreads
+#if defined(_WIN32)
+    #include <Windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+typedef void(*thread_fn)(void *arg);
+
+// must stay at the same address until joined, the new thread reads fn and arg from it
+struct thread
+{
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    thread_fn fn;
+    void *arg;
+};
+
+struct mutex
+{
+#if defined(_WIN32)
+    CRITICAL_SECTION handle;
+#else
+    pthread_mutex_t handle;
+#endif
+};
+
+struct condition
+{
+#if defined(_WIN32)
+    CONDITION_VARIABLE handle;
+#else
+    pthread_cond_t handle;
+#endif
+};
+
+// returns 0 on success, -1 if the thread could not be started
+int thread_create(struct thread *thread, thread_fn fn, void *arg);
+void thread_join(struct thread *thread);
+
+void mutex_init(struct mutex *mutex);
+void mutex_destroy(struct mutex *mutex);
+void mutex_lock(struct mutex *mutex);
+void mutex_unlock(struct mutex *mutex);
+
+// the mutex must be held, it is released while waiting. wakeups may be spurious, so always wait in a loop.
+void condition_init(struct condition *condition);
+void condition_destroy(struct condition *condition);
+void condition_wait(struct condition *condition, struct mutex *mutex);
+void condition_signal(struct condition *condition);
+void condition_broadcast(struct condition *condition);